@@ -7,6 +7,10 @@
 #include "../Common/Timer.h"
 #include "../Common/Input.h"
 #include "../Common/CmdArgs.h"
+#include "../Common/TileSchedule.h"
+#include "../Common/ActiveTiles.h"
+#include "../Common/CellRules.h"
+#include "../Common/CellPlane.h"
 
 const char EARTH = 'e';
 const char AIR = 'a';
@@ -14,75 +18,134 @@ const char COAL = 'c';
 const char DRILL = 'd';
 const char VOID = 'v';
 const char STATIC_VOID = 's';
+const char PILLAR = 'p';	// Seam beyond the end of the panel, which the drill stops at
+
+const int RADIUS = 3;
 
 CellGrid2D grid;
-SelectionSet<int> neighbourhood;
+CellRules rules;
+KillBubble killBubble;
+TileSchedule schedule;
+ActiveTiles active;
 Timer timer;
 int width;
 int height;
 float drawScale;
-int drillLength;
-float killBubble;
+bool synchronous;
+bool settled;
+unsigned int iteration;
 
-void Update(double deltaTime)
+// One phase of a synchronous update of a column, from top to bottom (see CellRules)
+template<typename Grid>
+bool UpdateColumn(Grid &grid, int x, enum CellRules::Phase phase)
 {
-	if (Key.escape)
-		exit(0);
+	bool live = false;
+	for (int y = grid.GetHeight() - 1; y >= 0; y--)
+		live |= rules.UpdateSynchronous(grid, x, y, 0, iteration, phase);
+	return live;
+}
+
+// Update the active tiles from right to left, columns far enough from the left and right
+// borders for their whole neighbourhood to be inside the grid skip bounds logic entirely.
+// The rules are those of the 3D drivers, applied to the grid as the plane z = 0.
+struct IterateColumns
+{
+	int reach;
 	
-	// Update from top-right to bottom-left
-	// This prevents void and drill cells from being updated multiple times in a single iteration
-	for (int x = grid.GetWidth() - 1; x >= 0 ; x--)
+	template<typename Edge, typename Interior>
+	void operator()(Edge &edge, Interior &interior)
 	{
-		for (int y = grid.GetHeight() - 1; y >= 0; y--)
+		CellPlane<Edge> edgePlane(edge);
+		CellPlane<Interior> interiorPlane(interior);
+		const std::vector<Tile> &tiles = schedule.GetTiles();
+		for (unsigned int t = 0; t < tiles.size(); t++)
 		{
-			int offset;
-			switch (grid(x, y))
+			if (!active.IsActive(tiles[t]))
+				continue;
+			
+			bool live = false;
+			for (int x = tiles[t].x1 - 1; x >= tiles[t].x0; x--)
 			{
-				case VOID:
-					offset = neighbourhood.RouletteSelect();
-					// move 'bubble' up through earth and air - do not move through coal or static voids
-					if (grid(x + offset, y + 1) == EARTH || grid(x + offset, y + 1) == AIR)
-					{
-						// small chance of getting stuck - convert to static void
-						if (Random::Float() < killBubble)
-							grid(x, y) = STATIC_VOID;
-						else 
-						{
-							// Swap value with neighbour chosen using selection set
-							grid(x, y) = grid(x + offset, y + 1);
-							grid(x + offset, y + 1) = VOID;
-						}
-					}
-					break;
-				case DRILL:
-					// Create void cell where coal was, move right one
-					grid(x, y) = VOID;
-					if (x < (width - drillLength) / 2 + drillLength)
-						grid(x + 1, y) = DRILL;
-					break;
-				case EARTH:
-					// Compress down if air or static void is underneath - prevent floating blocks
-					if (grid(x, y - 1) == AIR || grid(x, y - 1) == STATIC_VOID)
-					{
-						// At least one of the cells to the left, right, lower-left or lower-right
-						// must also be air/static void for compression to occur
-						if (grid(x - 1, y - 1) == AIR || grid(x + 1, y - 1) == AIR
-							|| grid(x - 1, y) == AIR || grid(x + 1, y) == AIR
-							|| grid(x - 1, y - 1) == STATIC_VOID || grid(x + 1, y - 1) == STATIC_VOID
-							|| grid(x - 1, y) == STATIC_VOID || grid(x + 1, y) == STATIC_VOID)
-						{
-							// Compress all cells above downward
-							for (int i = y - 1; i < height; i++)
-								grid(x, i) = grid(x, i + 1);
-							//char temp = grid(x, y - 1);
-							//grid(x, y - 1) = grid(x, y);
-							//grid(x, y) = temp;
-						}
-					}
-					break;
+				if (x >= reach && x < edge.GetWidth() - reach)
+					live |= rules.UpdateColumn(interiorPlane, x, 0, iteration);
+				else
+					live |= rules.UpdateColumn(edgePlane, x, 0, iteration);
+			}
+			if (live)
+				active.MarkLive(tiles[t]);
+		}
+	}
+};
+
+// Synchronous update of the active tiles - each phase over all of them before the next.
+// Claims are checked against voids up to two radii away.
+struct IterateSynchronous
+{
+	int reach;
+	
+	template<typename Edge, typename Interior>
+	void operator()(Edge &edge, Interior &interior)
+	{
+		static const enum CellRules::Phase phases[3] = { CellRules::PROPOSE, CellRules::RESOLVE, CellRules::SETTLE };
+		
+		// Tiles activated by the update wait for the next iteration
+		std::vector<Tile> tiles;
+		for (unsigned int t = 0; t < schedule.GetTiles().size(); t++)
+		{
+			if (active.IsActive(schedule.GetTiles()[t]))
+				tiles.push_back(schedule.GetTiles()[t]);
+		}
+		
+		CellPlane<Edge> edgePlane(edge);
+		CellPlane<Interior> interiorPlane(interior);
+		for (int p = 0; p < 3; p++)
+		{
+			for (unsigned int t = 0; t < tiles.size(); t++)
+			{
+				bool live = false;
+				for (int x = tiles[t].x0; x < tiles[t].x1; x++)
+				{
+					if (x >= reach && x < edge.GetWidth() - reach)
+						live |= UpdateColumn(interiorPlane, x, phases[p]);
+					else
+						live |= UpdateColumn(edgePlane, x, phases[p]);
+				}
+				if (live)
+					active.MarkLive(tiles[t]);
 			}
 		}
 	}
+};
+
+void Update(double deltaTime)
+{
+	if (Key.escape)
+		exit(0);
+	
+	// Nothing but voids in the air (drawn as air) moves once the grid has settled
+	if (settled)
+		return;
+	
+	// Synchronous updates read the cells as they were at the start of the iteration, so
+	// columns may be updated in any order
+	active.Advance();
+	iteration++;
+	rules.ResetSettled();
+	if (synchronous)
+	{
+		grid.ResetHalo();
+		grid.Snapshot();
+		IterateSynchronous iterate = { 2 * RADIUS };
+		DispatchBounds(grid, iterate, iterate.reach, 1);
+	}
+	else
+	{
+		// Update from top-right to bottom-left
+		// This prevents void and drill cells from being updated multiple times in a single iteration
+		IterateColumns iterate = { rules.GetReach(RADIUS) };
+		DispatchBounds(grid, iterate, iterate.reach, 1);
+	}
+	settled = rules.IsSettled();
 }
 
 void Render()
@@ -105,6 +168,7 @@ void Render()
 					colour = Colour::LightBlue();
 					break;
 				case COAL:
+				case PILLAR:
 					colour = Colour::Blue();
 					break;
 				case AIR:
@@ -139,6 +203,7 @@ int main(int argc, char **argv)
 	args.SetDefault("dl", 400);	// Drill Length
 	args.SetDefault("gh", 200);	// Ground Height
 	args.SetDefault("ds", 2);	// Draw Scale
+	args.SetDefault("sync", 0);	// Synchronous updates
 	
 	// Load parameters
 	int xRes = args.Get<int>("rx");
@@ -147,23 +212,42 @@ int main(int argc, char **argv)
 	height = args.Get<int>("h") * yRes;
 	drawScale = args.Get<float>("ds");
 	int coalSeamHeight = args.Get<int>("csh") * yRes;
-	drillLength = args.Get<int>("dl") * xRes;
+	int drillLength = args.Get<int>("dl") * xRes;
 	int groundHeight = args.Get<int>("gh") * yRes;
-	killBubble = 0.2f / (groundHeight - coalSeamHeight);
+	float killProbability = 0.2f / (groundHeight - coalSeamHeight);
+	synchronous = args.Get<int>("sync") != 0;
+	iteration = 0;
 	
-	// Init selection set
+	// Init selection set - voids rise one row at a time
 	Random::SetSeed(); 
-	GenerateSelectionSet(neighbourhood, 0.0, 3.0, -3, 3);
+	SelectionSet<Vector3> selection;
+	GenerateSelectionSet(selection, 0.0, 3.0, -RADIUS, RADIUS);
 	
 	// Init cell grid
+	grid.SetBuffered(synchronous);
+	grid.SetHalo(1);
 	grid.SetSize(width, height);
 	grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::TOP);
 	grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::BOTTOM);
 	grid.Fill(EARTH);
 	grid.FillRect(0, groundHeight, width, height - groundHeight, AIR);
 	grid.FillRect(0, 0, width, coalSeamHeight, COAL);
+	int panelEnd = (width - drillLength) / 2 + drillLength;
+	grid.FillRect(panelEnd + 1, 0, width - panelEnd - 1, coalSeamHeight, PILLAR);
 	grid.FillRect((width - drillLength) / 2, 0, 1, coalSeamHeight, DRILL);
 	
+	// Default rules (see CellRules), the drill advances through coal up to the pillar
+	killBubble.Create(killProbability, KillBubble::BERNOULLI, 0, 0, 0, false, false);
+	rules.SetNeighbourhood(CellPlane<CellGrid2D>(grid), selection);
+	rules.SetKillBubble(&killBubble);
+	rules.SetSettling(true);
+	settled = false;
+	
+	// Split grid into tiles of columns, only tiles where rules apply are updated
+	bool wrap = grid.GetBoundMode(CellGrid2D::LEFT) == CellGrid2D::WRAP || grid.GetBoundMode(CellGrid2D::RIGHT) == CellGrid2D::WRAP;
+	schedule.Create(width, 1, 16, rules.GetReach(RADIUS), wrap, false);
+	active.Create(schedule, wrap, false);
+	
 	// Setup OpenGL window
 	InitWindow(drawScale * width + 100, drawScale * height + 100, "Cellular Automata Test", Colour::Black());
 	timer.Start();
@@ -7,40 +7,76 @@
 #include "../Common/Input.h"
 #include "../Common/Heightmap.h"
 #include "../Common/Xml.h"
+#include "../Common/MathUtils.h"
+#include "../Common/TileSchedule.h"
+#include "../Common/ActiveTiles.h"
+#include "../Common/SurfaceIndex.h"
+#include "../Common/CellRules.h"
+#include "../Common/MiningPlan.h"
 
+// Surface of the heightmap (cell states and rules are set in the config, see CellRules)
 const char EARTH = 'e';
-const char AIR  = 'a';
-const char COAL = 'c';
-const char DRILL = 'd';
-const char VOID  = 'v';
-const char STATIC_VOID = 's';
 
 int iterations;
-float killBubble;
+int radius;
 Vector3 dimensions;
 Vector3 resolution;
 Vector2 colourRange;
 float heightmapSmoothing;
 CellGrid3D grid;
-SelectionSet<Vector3> neighbourhood;
+CellRules rules;
+MiningPlan plan;
+KillBubble killBubble;
+TileSchedule schedule;
+ActiveTiles active;
+SurfaceIndex surface;
+Heightmap hmap;
 Timer timer;
 OrbitCamera camera;
 
-void HeightmapFromCellGrid(Heightmap &hmap)
+// Update the active tiles from top-right to bottom-left, columns far enough from the x/z
+// borders for their whole neighbourhood to be inside the grid skip bounds logic entirely
+struct IterateColumns
 {
-	hmap.SetSize(grid.GetWidth(), grid.GetDepth());
-	for (int x = 0; x < grid.GetWidth(); x++)
+	CellRules *rules;
+	unsigned int iteration;
+	int reach;
+	const TileSchedule *schedule;
+	ActiveTiles *active;
+	
+	template<typename Edge, typename Interior>
+	void operator()(Edge &edge, Interior &interior)
 	{
-		for (int z = 0; z < grid.GetDepth(); z++)
+		const std::vector<Tile> &tiles = schedule->GetTiles();
+		for (unsigned int t = 0; t < tiles.size(); t++)
 		{
-			int y = grid.GetHeight() - 1;
-			while (grid(x, y, z) != EARTH)
-				y--;
+			const Tile &tile = tiles[t];
+			if (!active->IsActive(tile))
+				continue;
 			
-			hmap(x, z) = y;
+			bool live = false;
+			for (int z = tile.z1 - 1; z >= tile.z0; z--)
+			{
+				bool zInside = z >= reach && z < edge.GetDepth() - reach;
+				for (int x = tile.x1 - 1; x >= tile.x0; x--)
+				{
+					if (zInside && x >= reach && x < edge.GetWidth() - reach)
+						live |= rules->UpdateColumn(interior, x, z, iteration);
+					else
+						live |= rules->UpdateColumn(edge, x, z, iteration);
+				}
+			}
+			if (live)
+				active->MarkLive(tile);
 		}
 	}
-	hmap.Smooth(heightmapSmoothing);
+};
+
+void Iterate(CellGrid3D &grid, CellRules &rules, int radius, unsigned int iteration, const TileSchedule &schedule, ActiveTiles &active)
+{
+	active.Advance();
+	IterateColumns iterate = { &rules, iteration, rules.GetReach(radius), &schedule, &active };
+	DispatchBounds(grid, iterate, iterate.reach, 1, iterate.reach);
 }
 
 void Update(double deltaTime)
@@ -51,72 +87,15 @@ void Update(double deltaTime)
 	static int iterationCount = 0;
 	if (iterationCount++ < iterations)
 	{
-		for (int z = grid.GetDepth() - 1; z >= 0; z--)
-		{
-			for (int x = grid.GetWidth() - 1; x >= 0 ; x--)
-			{
-				for (int y = grid.GetHeight() - 1; y >= 0; y--)
-				{
-					Vector3 offset, target;
-					
-					switch (grid(x, y, z))
-					{
-						case VOID:			
-							offset = neighbourhood.RouletteSelect();
-							target = Vector3(x, y, z) + offset;
-							if (grid(target) == EARTH || grid(target) == AIR)
-							{
-								if (Random::Float() < killBubble)
-									grid(x, y, z) = STATIC_VOID;
-								else 
-								{
-									grid(x, y, z) = grid(target);
-									grid(target) = VOID;
-								}
-							}
-							break;
-							
-						case DRILL:
-							grid(x, y, z) = VOID;
-							if (grid(x, y, z + 1) == COAL)
-								grid(x, y, z + 1) = DRILL;
-							else if (grid(x, y, z - 1) == COAL)
-								grid(x, y, z - 1) = DRILL;
-							else if (grid(x + 1, y, z) == COAL)
-								grid(x + 1, y, z) = DRILL;
-							else if (grid(x - 1, y, z) == COAL)
-								grid(x - 1, y, z) = DRILL;
-							break;
-							
-						case EARTH:
-							if (grid(x, y - 1 , z) == AIR || grid(x, y - 1, z) == STATIC_VOID)
-							{
-								if (grid(x - 1, y - 1, z) == AIR 
-								 || grid(x + 1, y - 1, z) == AIR
-								 || grid(x, y - 1, z - 1) == AIR 
-								 || grid(x, y - 1, z + 1) == AIR
-								 || grid(x - 1, y, z) == AIR 
-								 || grid(x + 1, y, z) == AIR
-								 || grid(x, y, z - 1) == AIR 
-								 || grid(x, y, z + 1) == AIR
-								 || grid(x - 1, y - 1, z) == STATIC_VOID 
-								 || grid(x + 1, y - 1, z) == STATIC_VOID
-								 || grid(x, y - 1, z - 1) == STATIC_VOID 
-								 || grid(x, y - 1, z + 1) == STATIC_VOID
-								 || grid(x - 1, y, z) == STATIC_VOID 
-								 || grid(x + 1, y, z) == STATIC_VOID
-								 || grid(x, y, z - 1) == STATIC_VOID 
-								 || grid(x, y, z + 1) == STATIC_VOID)
-								{
-									for (int i = y - 1; i < grid.GetHeight(); i++)
-										grid(x, i, z) = grid(x, i + 1, z);
-								}
-							}
-							break;
-					}
-				}
-			}
-		}
+		TileObserver observer = { &schedule, &active };
+		plan.Advance(grid, rules, iterationCount, observer);
+		rules.ResetSettled();
+		Iterate(grid, rules, radius, iterationCount, schedule, active);
+		surface.Update(grid, schedule, active);
+		
+		// Nothing but voids in the air moves once the grid has settled
+		if (rules.IsSettled() && (unsigned int)iterationCount > plan.GetLastIteration())
+			iterations = iterationCount;
 	}
 
 	camera.Update(deltaTime);
@@ -124,8 +103,8 @@ void Update(double deltaTime)
 
 void Render()
 {	
-	Heightmap hmap;
-	HeightmapFromCellGrid(hmap);
+	surface.CopyTo(hmap);
+	hmap.Smooth(heightmapSmoothing);
 	
 	PerspectiveMode(&camera);
 	RenderHeightmap(hmap, Vector3(1) / resolution, colourRange[0], colourRange[1]);
@@ -145,6 +124,7 @@ int main(int argc, char **argv)
 	// Setup grid
 	dimensions = xml.Get<Vector3>("Grid/Dimensions");
 	resolution = xml.Get<Vector3>("Grid/Resolution");
+	grid.SetHalo(1);
 	grid.SetSize(dimensions * resolution);
 	
 	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Top"), CellGrid3D::TOP);
@@ -170,13 +150,29 @@ int main(int argc, char **argv)
 	// Setup selection set (cell neighbourhood)
 	Vector2 mean = xml.Get<Vector2>("SelectionSet/Mean");
 	Vector2 variance = xml.Get<Vector2>("SelectionSet/Variance");
-	int radius = xml.Get<int>("SelectionSet/Radius");
-	GenerateSelectionSet(neighbourhood, mean, variance, radius);
+	radius = xml.Get<int>("SelectionSet/Radius");
+	SelectionSet<Vector3> selection;
+	GenerateSelectionSet(selection, mean, variance, radius);
 	Random::SetSeed();
 	
+	// Compile the rules
+	rules.Load(xml);
+	rules.SetNeighbourhood(grid, selection);
+	rules.SetKillBubble(&killBubble);
+	rules.SetSettling(true);
+	plan.Load(xml, resolution);
+	
+	// Split grid into tiles of columns, only tiles where rules apply are updated
+	bool wrapX = grid.GetBoundMode(CellGrid3D::LEFT) == CellGrid3D::WRAP || grid.GetBoundMode(CellGrid3D::RIGHT) == CellGrid3D::WRAP;
+	bool wrapZ = grid.GetBoundMode(CellGrid3D::FRONT) == CellGrid3D::WRAP || grid.GetBoundMode(CellGrid3D::BACK) == CellGrid3D::WRAP;
+	schedule.Create(grid.GetWidth(), grid.GetDepth(), xml.Get<int>("TileSize", 16), rules.GetReach(radius), wrapX, wrapZ);
+	active.Create(schedule, wrapX, wrapZ);
+	surface.Create(grid.GetWidth(), grid.GetDepth(), EARTH);
+	surface.Update(grid);
+	
 	// Load simulation parameters
 	iterations = xml.Get<int>("Iterations");
-	killBubble = xml.Get<float>("KillBubble");
+	killBubble.Create(xml.Get<float>("KillBubble"), KillBubble::BERNOULLI, 0, 0, 0, false, false);
 	colourRange = xml.Get<Vector2>("ColourRange") * resolution.y;
 	heightmapSmoothing = xml.Get<float>("HeightmapSmoothing");
 	
@@ -0,0 +1,135 @@
+
+#include "ActiveTiles.h"
+#include "MathUtils.h"
+#include <cassert>
+
+ActiveTiles::ActiveTiles()
+{
+	m_tilesX = 0;
+	m_tilesZ = 0;
+	m_wrapX = false;
+	m_wrapZ = false;
+	m_numActive = 0;
+}
+
+ActiveTiles::ActiveTiles(const TileSchedule &schedule, bool wrapX, bool wrapZ)
+{
+	Create(schedule, wrapX, wrapZ);
+}
+
+void ActiveTiles::Create(const TileSchedule &schedule, bool wrapX, bool wrapZ)
+{
+	m_tilesX = schedule.GetTilesX();
+	m_tilesZ = schedule.GetTilesZ();
+	m_wrapX = wrapX;
+	m_wrapZ = wrapZ;
+	m_current.assign(m_tilesX * m_tilesZ, 1);
+	m_next.assign(m_tilesX * m_tilesZ, 1);
+	m_lastLive.assign(m_tilesX * m_tilesZ, 0);
+	m_numActive = m_tilesX * m_tilesZ;
+}
+
+bool ActiveTiles::IsActive(const Tile &tile) const
+{
+	return m_current[tile.j * m_tilesX + tile.i] != 0;
+}
+
+void ActiveTiles::MarkLive(const Tile &tile)
+{
+	for (int dj = -1; dj <= 1; dj++)
+	{
+		int j = tile.j + dj;
+		if (j < 0 || j >= m_tilesZ)
+		{
+			if (!m_wrapZ)
+				continue;
+			j = (j + m_tilesZ) % m_tilesZ;
+		}
+		
+		for (int di = -1; di <= 1; di++)
+		{
+			int i = tile.i + di;
+			if (i < 0 || i >= m_tilesX)
+			{
+				if (!m_wrapX)
+					continue;
+				i = (i + m_tilesX) % m_tilesX;
+			}
+			
+			// Neighbours not yet swept this iteration are updated now, others next time
+			int index = j * m_tilesX + i;
+			__sync_fetch_and_or(&m_current[index], 1);
+			__sync_fetch_and_or(&m_next[index], 1);
+		}
+	}
+}
+
+void ActiveTiles::ActivateAll()
+{
+	m_current.assign(m_current.size(), 1);
+	m_next.assign(m_next.size(), 1);
+	m_numActive = m_current.size();
+}
+
+bool ActiveTiles::IsActive(const Tile &tile, unsigned int iteration) const
+{
+	for (int dj = -1; dj <= 1; dj++)
+	{
+		int j = tile.j + dj;
+		if (j < 0 || j >= m_tilesZ)
+		{
+			if (!m_wrapZ)
+				continue;
+			j = (j + m_tilesZ) % m_tilesZ;
+		}
+		
+		for (int di = -1; di <= 1; di++)
+		{
+			int i = tile.i + di;
+			if (i < 0 || i >= m_tilesX)
+			{
+				if (!m_wrapX)
+					continue;
+				i = (i + m_tilesX) % m_tilesX;
+			}
+			
+			if (m_lastLive[j * m_tilesX + i] + 1 >= iteration)
+				return true;
+		}
+	}
+	return false;
+}
+
+void ActiveTiles::MarkLive(const Tile &tile, unsigned int iteration)
+{
+	// Tiles are updated out of iteration order, keep the latest
+	unsigned int &lastLive = m_lastLive[tile.j * m_tilesX + tile.i];
+	lastLive = Max(lastLive, iteration);
+}
+
+void ActiveTiles::ActivateAll(unsigned int iteration)
+{
+	for (unsigned int i = 0; i < m_lastLive.size(); i++)
+		m_lastLive[i] = Max(m_lastLive[i], iteration - 1);
+}
+
+int ActiveTiles::Advance()
+{
+	m_current.swap(m_next);
+	m_next.assign(m_next.size(), 0);
+	
+	m_numActive = 0;
+	for (unsigned int i = 0; i < m_current.size(); i++)
+		m_numActive += m_current[i];
+	return m_numActive;
+}
+
+int ActiveTiles::GetNumActive() const
+{
+	return m_numActive;
+}
+
+int ActiveTiles::GetNumTiles() const
+{
+	return m_current.size();
+}
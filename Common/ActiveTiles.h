@@ -0,0 +1,83 @@
+
+/*
+ * @file	ActiveTiles.h/.cpp
+ * @brief	Tracks which tiles of a TileSchedule need updating.
+ * @details	Most of the grid is static once the drill has passed, so only tiles where a
+ *			rule could apply are updated. A tile is live if a rule changed any of its cells
+ *			or it holds cells that act every iteration (e.g. void and drill cells). A live
+ *			tile activates itself and its neighbours (the only tiles it can write to or be
+ *			read by, see TileSchedule) for the rest of the current sweep and for the next
+ *			iteration. A tile that is not active therefore has no cell a rule applies to,
+ *			and skipping it gives the same result as a full sweep.
+ *			MarkLive() may be called from concurrent tile updates.
+ *			A time-blocked sweep (see TimeSkew) updates tiles several iterations apart, so
+ *			instead of flags for the current sweep it records the last iteration each tile
+ *			was live in: a tile is active in an iteration if it or a neighbour was live in
+ *			that iteration or the one before. These overloads take the iteration.
+ *			Call ActivateAll() after changing cells outside of an update, or tell a
+ *			TileObserver about every cell changed.
+ * @author	Matt Drage
+ * @date	25/02/2013
+ */
+
+#ifndef ACTIVETILES_H
+#define ACTIVETILES_H
+
+#include <vector>
+#include "TileSchedule.h"
+
+class ActiveTiles
+{
+	public:
+		// Constructors
+		ActiveTiles();
+		ActiveTiles(const TileSchedule &schedule, bool wrapX, bool wrapZ);
+
+		// One flag per tile of the schedule, all tiles active
+		void Create(const TileSchedule &schedule, bool wrapX, bool wrapZ);
+
+		bool IsActive(const Tile &tile) const;
+		void MarkLive(const Tile &tile);
+		void ActivateAll();
+
+		// Time-blocked sweeps, all tiles active from 'iteration' on after ActivateAll()
+		bool IsActive(const Tile &tile, unsigned int iteration) const;
+		void MarkLive(const Tile &tile, unsigned int iteration);
+		void ActivateAll(unsigned int iteration);
+
+		// Start the next iteration's sweep, returns the number of active tiles
+		int Advance();
+		int GetNumActive() const;
+		int GetNumTiles() const;
+
+	private:
+		int m_tilesX;
+		int m_tilesZ;
+		bool m_wrapX;
+		bool m_wrapZ;
+		int m_numActive;
+		std::vector<char> m_current;
+		std::vector<char> m_next;
+		std::vector<unsigned int> m_lastLive;
+};
+
+// Observer (see CellRules) marking the tile of every changed cell live, for cells changed
+// outside of a tile update (e.g. by a MiningPlan) before the iteration's sweep
+struct TileObserver
+{
+	const TileSchedule *schedule;
+	ActiveTiles *active;
+	
+	void Changed(int x, int y, int z)
+	{
+		active->MarkLive(schedule->GetTile(x, z));
+	}
+	
+	void Shifted(int x, int y, int z)
+	{
+		Changed(x, y, z);
+	}
+};
+typedef struct TileObserver TileObserver;
+
+#endif
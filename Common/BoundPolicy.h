@@ -0,0 +1,61 @@
+/*
+ * @file	BoundPolicy.h
+ * @brief	Compile-time bound handling for cell grid views.
+ * @details	A bound policy resolves a coordinate on one axis of a grid. Policies are used as
+ *			template parameters of CellView2D/CellView3D so the bound mode of each axis is
+ *			fixed at compile time and cell access needs no runtime mode switch.
+ *				- WrapBound: coordinates less than one grid size outside the border wrap
+ *					around to the opposite border (branch-free).
+ *				- HaloBound: coordinates are used as they are. Valid inside the grid, and on
+ *					border/ignore axes for coordinates that fall inside the ghost halo.
+ *				- ExceptionBound: coordinates outside the grid throw std::out_of_range.
+ *			LINEAR is true for policies that leave coordinates unchanged, so a cell's
+ *			neighbours are at fixed distances from it in memory (see CellOffset).
+ *			GetBoundPolicy() of each grid reports which policy matches the runtime bound
+ *			modes of an axis, or RUNTIME_BOUND if none does (e.g. mixed modes).
+ * @author	Matt Drage
+ * @date	04/02/2013
+ */
+
+#ifndef BOUNDPOLICY_H
+#define BOUNDPOLICY_H
+
+#include <stdexcept>
+
+enum BoundPolicyType { RUNTIME_BOUND, WRAP_BOUND, HALO_BOUND, EXCEPTION_BOUND };
+
+struct WrapBound
+{
+	static const bool LINEAR = false;
+	
+	static int Apply(int i, int size)
+	{
+		i += (i < 0) ? size : 0;
+		i -= (i >= size) ? size : 0;
+		return i;
+	}
+};
+
+struct HaloBound
+{
+	static const bool LINEAR = true;
+	
+	static int Apply(int i, int size)
+	{
+		return i;
+	}
+};
+
+struct ExceptionBound
+{
+	static const bool LINEAR = false;
+	
+	static int Apply(int i, int size)
+	{
+		if ((unsigned)i >= (unsigned)size)
+			throw std::out_of_range("Invalid cell index");
+		return i;
+	}
+};
+
+#endif
@@ -3,12 +3,20 @@
 #include "MathUtils.h"
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
 
 CellGrid2D::CellGrid2D()
 {
 	m_width = 0;
 	m_height = 0;
+	m_halo = 0;
+	m_stride = 0;
+	m_buffered = false;
+	m_data = NULL;
 	m_cells = NULL;
+	m_previousData = NULL;
+	m_previous = NULL;
+	m_dummy = 0;
 	
 	for (int i = 0; i < 4; i++)
 	{
@@ -21,7 +29,14 @@ CellGrid2D::CellGrid2D(int width, int height)
 {
 	m_width = 0;
 	m_height = 0;
+	m_halo = 0;
+	m_stride = 0;
+	m_buffered = false;
+	m_data = NULL;
 	m_cells = NULL;
+	m_previousData = NULL;
+	m_previous = NULL;
+	m_dummy = 0;
 	
 	for (int i = 0; i < 4; i++)
 	{
@@ -34,24 +49,49 @@ CellGrid2D::CellGrid2D(int width, int height)
 
 CellGrid2D::~CellGrid2D()
 {
-	delete[] m_cells;
+	delete[] m_data;
+	delete[] m_previousData;
+	m_data = NULL;
 	m_cells = NULL;
+	m_previousData = NULL;
+	m_previous = NULL;
 }
 
 bool CellGrid2D::SetSize(int width, int height)
 {
-	if (m_cells)
+	if (m_data || m_previousData)
 	{
-		delete[] m_cells;
+		delete[] m_data;
+		delete[] m_previousData;
+		m_data = NULL;
 		m_cells = NULL;
+		m_previousData = NULL;
+		m_previous = NULL;
 	}
 	
 	m_width = width;
 	m_height = height;
+	m_stride = m_width + 2 * m_halo;
 	
 	try
 	{
-		m_cells = new char[m_width * m_height];
+		int size = (m_height + 2 * m_halo) * m_stride;
+		if (m_buffered)
+		{
+			m_previousData = new char[size];
+			m_previous = m_previousData + m_halo * m_stride + m_halo;
+			memset(m_previousData, 0, size);
+		}
+		
+		m_data = new char[size];
+		m_cells = m_data + m_halo * m_stride + m_halo;
+		
+		// Ignore faces of the halo start out empty, border faces hold the border value
+		if (m_halo > 0)
+		{
+			memset(m_data, 0, size);
+			ResetHalo();
+		}
 		return true;
 	}
 	catch (...)
@@ -70,6 +110,66 @@ int CellGrid2D::GetHeight() const
 	return m_height;
 }
 
+void CellGrid2D::SetHalo(int size)
+{
+	m_halo = size;
+	if (m_data)
+		SetSize(m_width, m_height);
+}
+
+int CellGrid2D::GetHalo() const
+{
+	return m_halo;
+}
+
+void CellGrid2D::SetBuffered(bool buffered)
+{
+	m_buffered = buffered;
+	if (m_data)
+		SetSize(m_width, m_height);
+}
+
+bool CellGrid2D::IsBuffered() const
+{
+	return m_buffered;
+}
+
+void CellGrid2D::Snapshot()
+{
+	if (m_previousData)
+		memcpy(m_previousData, m_data, (m_height + 2 * m_halo) * m_stride);
+}
+
+void CellGrid2D::ResetHalo()
+{
+	// x faces are filled last so they take precedence in the corners (matches ApplyBounds)
+	static const enum Border order[4] = { BOTTOM, TOP, LEFT, RIGHT };
+	for (int i = 0; i < 4; i++)
+	{
+		if (m_boundMode[order[i]] == BORDER)
+			FillHalo(order[i]);
+	}
+}
+
+void CellGrid2D::FillHalo(enum Border border)
+{
+	if (m_halo == 0 || m_data == NULL)
+		return;
+	
+	int x0 = -m_halo, x1 = m_width + m_halo;
+	int y0 = -m_halo, y1 = m_height + m_halo;
+	switch (border)
+	{
+		case LEFT:		x1 = 0;			break;
+		case RIGHT:		x0 = m_width;	break;
+		case BOTTOM:	y1 = 0;			break;
+		case TOP:		y0 = m_height;	break;
+	}
+	
+	for (int y = y0; y < y1; y++)
+		memset(m_cells + y * m_stride + x0, m_border[border], x1 - x0);
+}
+
 void CellGrid2D::SetBoundMode(enum BoundMode mode, char option)
 {
 	for (int i = 0; i < 4; i++)
@@ -79,6 +179,7 @@ void CellGrid2D::SetBoundMode(enum BoundMode mode, char option)
 	{
 		for (int i = 0; i < 4; i++)
 			m_border[i] = option;
+		ResetHalo();
 	}
 }
 
@@ -86,7 +187,10 @@ void CellGrid2D::SetBoundMode(enum BoundMode mode, enum Border border, char opti
 {
 	m_boundMode[border] = mode;
 	if (mode == BORDER)
+	{
 		m_border[border] = option;
+		ResetHalo();
+	}
 }
 
 enum CellGrid2D::BoundMode CellGrid2D::GetBoundMode(enum Border border) const
@@ -94,32 +198,54 @@ enum CellGrid2D::BoundMode CellGrid2D::GetBoundMode(enum Border border) const
 	return m_boundMode[border];
 }
 
-bool CellGrid2D::ApplyBounds(int &x, int &y) const
+enum BoundPolicyType CellGrid2D::GetBoundPolicy(enum Axis axis, int reach) const
 {
-	if (x >= m_width || x < 0)
+	enum Border low = (axis == X_AXIS) ? LEFT : BOTTOM;
+	enum Border high = (axis == X_AXIS) ? RIGHT : TOP;
+	
+	enum BoundMode mode = m_boundMode[low];
+	if (mode != m_boundMode[high])
+		return RUNTIME_BOUND;
+	
+	int size = (axis == X_AXIS) ? m_width : m_height;
+	switch (mode)
 	{
-		int b = x < 0 ? LEFT : RIGHT;
-		if (m_boundMode[b] == BORDER)
-			return m_border[b];
-		else if (m_boundMode[b] == WRAP)
-			x = Wrap(x, 1, m_width - 1);
-		else if (m_boundMode[b] == EXCEPTION)
-			throw std::out_of_range("Invalid cell index");
-		else
-			return true;
+		case WRAP:
+			return (reach <= size) ? WRAP_BOUND : RUNTIME_BOUND;
+		case EXCEPTION:
+			return EXCEPTION_BOUND;
+		default:
+			return (reach <= m_halo) ? HALO_BOUND : RUNTIME_BOUND;
 	}
-	if (y >= m_height || y < 0)
+}
+
+bool CellGrid2D::ApplyBound(int &i, int size, enum Border low, enum Border high) const
+{
+	int b = i < 0 ? low : high;
+	switch (m_boundMode[b])
 	{
-		int b = y < 0 ? BOTTOM : TOP;
-		if (m_boundMode[b] == BORDER)
-			return m_border[b];
-		else if (m_boundMode[b] == WRAP)
-			y = Wrap(y, 1, m_height - 1);
-		else if (m_boundMode[b] == EXCEPTION)
+		case WRAP:
+			i = ((i % size) + size) % size;
+			return false;
+		case EXCEPTION:
 			throw std::out_of_range("Invalid cell index");
-		else
-			return true;
-	}	
+		case BORDER:
+			m_dummy = m_border[b];
+			break;
+		case IGNORE:
+			break;
+	}
+	
+	// Cells inside the halo are stored, any further out are redirected to the dummy cell
+	return i < -m_halo || i >= size + m_halo;
+}
+
+bool CellGrid2D::ApplyBounds(int &x, int &y) const
+{
+	if ((x >= m_width || x < 0) && ApplyBound(x, m_width, LEFT, RIGHT))
+		return true;
+	if ((y >= m_height || y < 0) && ApplyBound(y, m_height, BOTTOM, TOP))
+		return true;
 	return false;
 }
 
@@ -127,37 +253,60 @@ char& CellGrid2D::operator()(int x, int y)
 {
 	bool ignore = ApplyBounds(x, y);
 	if (ignore) return m_dummy;
-	return m_cells[y * m_width + x];
+	return m_cells[y * m_stride + x];
 }
 
 char CellGrid2D::operator()(int x, int y) const
 {
 	bool ignore = ApplyBounds(x, y);
 	if (ignore) return m_dummy;
-	return m_cells[y * m_width + x];
+	return m_cells[y * m_stride + x];
+}
+
+char& CellGrid2D::Previous(int x, int y)
+{
+	bool ignore = ApplyBounds(x, y);
+	if (ignore) return m_dummy;
+	return m_previous[y * m_stride + x];
 }
 
 void CellGrid2D::Fill(char value)
 {
 	for (int y = 0; y < m_height; y++)
+		memset(m_cells + y * m_stride, value, m_width);
+}
+
+void CellGrid2D::FillRect(int x, int y, int width, int height, char value)
+{
+	// The part inside the grid a row at a time, the rest through the bounds logic
+	int x0 = Max(x, 0), x1 = Min(x + width, m_width);
+	int y0 = Max(y, 0), y1 = Min(y + height, m_height);
+	if (x0 >= x1 || y0 >= y1)
 	{
-		for (int x = 0; x < m_width; x++)
-			m_cells[y * m_width + x] = value;
+		FillCells(x, y, x + width, y + height, value);
+		return;
 	}
+	
+	for (int cy = y0; cy < y1; cy++)
+		memset(m_cells + cy * m_stride + x0, value, x1 - x0);
+	FillCells(x, y, x + width, y0, value);
+	FillCells(x, y1, x + width, y + height, value);
+	FillCells(x, y0, x0, y1, value);
+	FillCells(x1, y0, x + width, y1, value);
 }
 
-void CellGrid2D::FillRect(int x, int y, int width, int height, char value)
+void CellGrid2D::FillCells(int x0, int y0, int x1, int y1, char value)
 {
-	for (int cy = y; cy < y + height; cy++)
+	for (int y = y0; y < y1; y++)
 	{
-		for (int cx = x; cx < x + width; cx++)
-			(*this)(cx, cy) = value;
+		for (int x = x0; x < x1; x++)
+			(*this)(x, y) = value;
 	}
 }
 
 char* CellGrid2D::GetRow(int index)
 {
-	return m_cells + index * m_width;
+	return m_cells + index * m_stride;
 }
 
 char* CellGrid2D::GetRawData()
@@ -165,11 +314,24 @@ char* CellGrid2D::GetRawData()
 	return m_cells;
 }
 
-void CellGrid2D::CopyCells(char *cellData, int width, int height, int xPosition, int yPosition)
+char* CellGrid2D::GetPreviousData()
+{
+	return m_previous;
+}
+
+int CellGrid2D::GetStride() const
+{
+	return m_stride;
+}
+
+void CellGrid2D::CopyCells(const char *cellData, int width, int height, int xPosition, int yPosition)
 {
 	for (int y = 0; y < height; y++)
-	{
-		for (int x = 0; x < width; x++)
-			m_cells[(y + yPosition) * m_width + (x + xPosition)] = cellData[y * width + x];
-	}
+		memcpy(m_cells + (y + yPosition) * m_stride + xPosition, cellData + y * width, width);
+}
+
+void CellGrid2D::ExtractCells(char *cellData, int width, int height, int xPosition, int yPosition)
+{
+	for (int y = 0; y < height; y++)
+		memcpy(cellData + y * width, m_cells + (y + yPosition) * m_stride + xPosition, width);
 }
@@ -19,15 +19,28 @@
  *					if this is not caught the program will abort.
  *				- Ignore: all coordinates outside the border will be ignored. Get will
  *					return an undefined value. Set will have no effect.
+ *			SetHalo(n) pads each row and the top and bottom of the grid with a ghost halo
+ *			n cells deep. Border faces of the halo hold the border value and ignore faces
+ *			act as a sink, so accesses that stay within the halo need no bounds logic.
+ *			CellView2D fixes the bound policy of each axis at compile time (see
+ *			BoundPolicy.h). DispatchBounds() selects the matching view for a grid's
+ *			runtime bound modes and passes it to a function object, along with an
+ *			unchecked view for columns whose neighbourhood lies inside the grid.
+ *			SetBuffered() adds a second buffer for synchronous updates: Snapshot()
+ *			copies the cells into it, and Previous() accesses the cells as they were at
+ *			the last snapshot while the grid itself is updated.
  * @author	Matt Drage
  * @date	12/12/2012
  */
 
+#include "BoundPolicy.h"
+
 class CellGrid2D
 {
 	public:
 		enum BoundMode { BORDER, WRAP, EXCEPTION, IGNORE };
 		enum Border { LEFT = 0, RIGHT = 1, TOP = 2, BOTTOM = 3 };
+		enum Axis { X_AXIS, Y_AXIS };
 	
 		// Constructors & Destructors
 		CellGrid2D();
@@ -39,36 +52,152 @@ class CellGrid2D
 		int GetWidth() const;
 		int GetHeight() const;
 	
+		// Ghost halo (reallocates the grid, so set it before filling)
+		void SetHalo(int size);
+		int GetHalo() const;
+		void ResetHalo();
+	
+		// Second buffer for synchronous updates (reallocates the grid, so set it before
+		// filling)
+		void SetBuffered(bool buffered);
+		bool IsBuffered() const;
+		void Snapshot();
+	
 		// Bound modes
 		void SetBoundMode(enum BoundMode mode, char option = 0);
 		void SetBoundMode(enum BoundMode mode, enum Border border, char option = 0);
 		enum BoundMode GetBoundMode(enum Border border) const;
+		enum BoundPolicyType GetBoundPolicy(enum Axis axis, int reach) const;
 	
 		// Cell access
 		char& operator()(int x, int y);
 		char operator()(int x, int y) const;
 	
+		// Cell access in the second buffer (see SetBuffered())
+		char& Previous(int x, int y);
+	
 		// Cell value initialisation
 		void Fill(char value);
 		void FillRect(int x, int y, int width, int height, char value);
 	
 		// CellGrid data copying (used for reconstructing larger CellGrid from multiple smaller
-		// ones when using MPI to divide grid).
-		void CopyCells(char *cellData, int width, int height, int xPosition, int yPosition);
+		// ones when using MPI to divide grid). cellData is dense, rows of 'width' cells,
+		// and the rectangle must lie inside the grid and halo.
+		void CopyCells(const char *cellData, int width, int height, int xPosition, int yPosition);
+		void ExtractCells(char *cellData, int width, int height, int xPosition, int yPosition);
 	
 		// Raw data access
+		// Pointer to cell (0, 0) - with a halo, rows are GetStride() apart rather than contiguous
 		char* GetRow(int index);
 		char* GetRawData();
+		char* GetPreviousData();
+		int GetStride() const;
 
 	private:
 		bool ApplyBounds(int &x, int &y) const;
+		bool ApplyBound(int &i, int size, enum Border low, enum Border high) const;
+		void FillHalo(enum Border border);
+		void FillCells(int x0, int y0, int x1, int y1, char value);
 	
 		int m_width;
 		int m_height;
+		int m_halo;
+		int m_stride;
+		bool m_buffered;
 		char m_border[4];
 		enum BoundMode m_boundMode[4];
+		char *m_data;
+		char *m_cells;
+		char *m_previousData;
+		char *m_previous;
+		mutable char m_dummy;
+};
+
+// Cell access with the bound policy of each axis fixed at compile time
+template<typename XPolicy, typename YPolicy>
+class CellView2D
+{
+	public:
+		typedef XPolicy XBound;
+		typedef YPolicy YBound;
+	
+		CellView2D(CellGrid2D &grid)
+		{
+			m_cells = grid.GetRawData();
+			m_previous = grid.GetPreviousData();
+			m_width = grid.GetWidth();
+			m_height = grid.GetHeight();
+			m_stride = grid.GetStride();
+		}
+	
+		int GetWidth() const { return m_width; }
+		int GetHeight() const { return m_height; }
+	
+		int Offset(int x, int y) const
+		{
+			return YBound::Apply(y, m_height) * m_stride + XBound::Apply(x, m_width);
+		}
+	
+		char& operator()(int x, int y) const
+		{
+			return m_cells[Offset(x, y)];
+		}
+	
+		// Cell (x, y) in the grid's second buffer (see CellGrid2D::SetBuffered())
+		char& Previous(int x, int y) const
+		{
+			return m_previous[Offset(x, y)];
+		}
+	
+	private:
 		char *m_cells;
-		char m_dummy;
+		char *m_previous;
+		int m_width;
+		int m_height;
+		int m_stride;
 };
 
+template<typename XBound, typename YBound, typename Func>
+void InvokeCellView2D(CellGrid2D &grid, Func &func)
+{
+	CellView2D<XBound, YBound> edge(grid);
+	CellView2D<HaloBound, YBound> interior(grid);
+	func(edge, interior);
+}
+
+template<typename XBound, typename Func>
+void DispatchBoundsY(CellGrid2D &grid, Func &func, enum BoundPolicyType y)
+{
+	switch (y)
+	{
+		case WRAP_BOUND: InvokeCellView2D<XBound, WrapBound>(grid, func); break;
+		case HALO_BOUND: InvokeCellView2D<XBound, HaloBound>(grid, func); break;
+		case EXCEPTION_BOUND: InvokeCellView2D<XBound, ExceptionBound>(grid, func); break;
+		default: func(grid, grid); break;
+	}
+}
+
+// Call func(edge, interior) with views matching the grid's bound modes.
+// The reach parameters give how far outside the grid func may access along each axis.
+// 'interior' performs no bounds logic on x, so is only valid for columns at least
+// reachX cells away from the left and right borders.
+// Falls back to func(grid, grid) if an axis has no matching compile-time policy.
+template<typename Func>
+void DispatchBounds(CellGrid2D &grid, Func &func, int reachX, int reachY)
+{
+	// Border values written into the halo during the last call are restored
+	grid.ResetHalo();
+	
+	enum BoundPolicyType x = grid.GetBoundPolicy(CellGrid2D::X_AXIS, reachX);
+	enum BoundPolicyType y = grid.GetBoundPolicy(CellGrid2D::Y_AXIS, reachY);
+	
+	switch (x)
+	{
+		case WRAP_BOUND: DispatchBoundsY<WrapBound>(grid, func, y); break;
+		case HALO_BOUND: DispatchBoundsY<HaloBound>(grid, func, y); break;
+		case EXCEPTION_BOUND: DispatchBoundsY<ExceptionBound>(grid, func, y); break;
+		default: func(grid, grid); break;
+	}
+}
+
 #endif
@@ -4,12 +4,40 @@
 #include <stdexcept>
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static const long HUGE_PAGE_SIZE = 2 * 1024 * 1024;
 
 CellGrid3D::CellGrid3D()
 {
 	m_width = 0;
 	m_height = 0;
+	m_depth = 0;
+	m_halo = 0;
+	m_strideX = 0;
+	m_strideY = 0;
+	m_strideZ = 0;
+	m_layout = ROWS;
+	m_brickX = NULL;
+	m_brickY = NULL;
+	m_brickZ = NULL;
+	m_mapped = false;
+	m_mappedSize = 0;
+	m_previousSize = 0;
+	m_pages = NORMAL_PAGES;
+	m_buffered = false;
+	m_data = NULL;
 	m_cells = NULL;
+	m_previousData = NULL;
+	m_previous = NULL;
+	m_dummy = 0;
 	InitBorders();
 }
 
@@ -17,7 +45,25 @@ CellGrid3D::CellGrid3D(int width, int height, int depth)
 {
 	m_width = 0;
 	m_height = 0;
+	m_depth = 0;
+	m_halo = 0;
+	m_strideX = 0;
+	m_strideY = 0;
+	m_strideZ = 0;
+	m_layout = ROWS;
+	m_brickX = NULL;
+	m_brickY = NULL;
+	m_brickZ = NULL;
+	m_mapped = false;
+	m_mappedSize = 0;
+	m_previousSize = 0;
+	m_pages = NORMAL_PAGES;
+	m_buffered = false;
+	m_data = NULL;
 	m_cells = NULL;
+	m_previousData = NULL;
+	m_previous = NULL;
+	m_dummy = 0;
 	InitBorders();
 	SetSize(width, height, depth);
 }
@@ -26,15 +72,45 @@ CellGrid3D::CellGrid3D(const Vector3 &size)
 {
 	m_width = 0;
 	m_height = 0;
+	m_depth = 0;
+	m_halo = 0;
+	m_strideX = 0;
+	m_strideY = 0;
+	m_strideZ = 0;
+	m_layout = ROWS;
+	m_brickX = NULL;
+	m_brickY = NULL;
+	m_brickZ = NULL;
+	m_mapped = false;
+	m_mappedSize = 0;
+	m_previousSize = 0;
+	m_pages = NORMAL_PAGES;
+	m_buffered = false;
+	m_data = NULL;
 	m_cells = NULL;
+	m_previousData = NULL;
+	m_previous = NULL;
+	m_dummy = 0;
 	InitBorders();
 	SetSize(size);
 }
 
 CellGrid3D::~CellGrid3D()
 {
-	delete[] m_cells;
+	Release();
+}
+
+void CellGrid3D::Release()
+{
+	if (m_data)
+		munmap(m_data, m_mappedSize);
+	if (m_previousData)
+		munmap(m_previousData, m_previousSize);
+	m_data = NULL;
 	m_cells = NULL;
+	m_previousData = NULL;
+	m_previous = NULL;
+	m_mapped = false;
 }
 
 void CellGrid3D::InitBorders()
@@ -48,25 +124,131 @@ void CellGrid3D::InitBorders()
 
 bool CellGrid3D::SetSize(int width, int height, int depth)
 {
-	if (m_cells)
-	{
-		delete[] m_cells;
-		m_cells = NULL;
-	}
+	if (m_data || m_previousData)
+		Release();
 	
 	m_width = width;
 	m_height = height;
 	m_depth = depth;
+	long origin;
+	if (m_layout == BRICKS)
+	{
+		// Brick columns along y, then z, then x
+		long brick = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+		long bricksY = (m_height + 2 * m_halo + BRICK_SIZE - 1) / BRICK_SIZE;
+		long bricksZ = (m_depth + 2 * m_halo + BRICK_SIZE - 1) / BRICK_SIZE;
+		m_strideX = 0;
+		m_strideY = 0;
+		m_strideZ = 0;
+		origin = CreateBrickOffsets(m_brickOffsets[Y_AXIS], m_height, 0, brick);
+		origin += CreateBrickOffsets(m_brickOffsets[Z_AXIS], m_depth, 1, bricksY * brick);
+		origin += CreateBrickOffsets(m_brickOffsets[X_AXIS], m_width, 2, bricksZ * bricksY * brick);
+		m_brickX = &m_brickOffsets[X_AXIS][m_halo];
+		m_brickY = &m_brickOffsets[Y_AXIS][m_halo];
+		m_brickZ = &m_brickOffsets[Z_AXIS][m_halo];
+	}
+	else
+	{
+		if (m_layout == COLUMNS)
+		{
+			m_strideY = 1;
+			m_strideZ = m_height + 2 * m_halo;
+			m_strideX = (m_depth + 2 * m_halo) * m_strideZ;
+		}
+		else
+		{
+			m_strideZ = 1;
+			m_strideX = m_depth + 2 * m_halo;
+			m_strideY = (m_width + 2 * m_halo) * m_strideX;
+		}
+		origin = m_halo * (m_strideY + m_strideX + m_strideZ);
+	}
+	long size = GetStorageSize();
 	
-	try
+	if (m_buffered)
 	{
-		m_cells = new char[m_width * m_height * m_depth];
-		return true;
+		m_previousData = AllocatePages(size, m_previousSize);
+		if (m_previousData == NULL)
+			return false;
+		m_previous = m_previousData + origin;
 	}
-	catch (...)
+	
+	if (!m_storageFile.empty())
 	{
+		// A new file is all zeros, so the halo needs no clearing
+		int fd = open(m_storageFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return false;
+		
+		void *data = MAP_FAILED;
+		if (ftruncate(fd, size) == 0)
+			data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		unlink(m_storageFile.c_str());
+		if (data == MAP_FAILED)
+			return false;
+		
+		m_data = (char*)data;
+		m_mapped = true;
+		m_mappedSize = size;
+		m_cells = m_data + origin;
+		ResetHalo();
+		return true;
+	}
+	
+	// Ignore faces of the halo start out empty (new pages are all zeros), border faces
+	// hold the border value
+	m_data = AllocatePages(size, m_mappedSize);
+	if (m_data == NULL)
 		return false;
+	m_cells = m_data + origin;
+	ResetHalo();
+	return true;
+}
+
+char* CellGrid3D::AllocatePages(long size, long &length) const
+{
+	void *data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if (m_pages == HUGE_PAGES)
+	{
+		length = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
 	}
+#endif
+	
+	// No reserved huge pages left - use transparent ones
+	if (data == MAP_FAILED)
+	{
+		length = size;
+		data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data == MAP_FAILED)
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		if (m_pages != NORMAL_PAGES)
+			madvise(data, length, MADV_HUGEPAGE);
+#endif
+	}
+	return (char*)data;
+}
+
+long CellGrid3D::CreateBrickOffsets(std::vector<long> &offsets, int size, int shift, long brickStride)
+{
+	// Offsets of stored cells (halo included) - Morton order inside a brick puts bit b
+	// of the coordinate at bit 3b + shift
+	offsets.resize((size + 2 * m_halo + BRICK_SIZE - 1) / BRICK_SIZE * BRICK_SIZE);
+	for (unsigned int i = 0; i < offsets.size(); i++)
+	{
+		int cell = i % BRICK_SIZE;
+		long morton = (cell & 1) | ((cell & 2) << 2) | ((cell & 4) << 4);
+		offsets[i] = (i / BRICK_SIZE) * brickStride + (morton << shift);
+	}
+	
+	// Relative to cell 0, returns the offset of cell 0 in the storage
+	long origin = offsets[m_halo];
+	for (unsigned int i = 0; i < offsets.size(); i++)
+		offsets[i] -= origin;
+	return origin;
 }
 
 bool CellGrid3D::SetSize(const Vector3 &size)
@@ -89,6 +271,116 @@ int CellGrid3D::GetDepth() const
 	return m_depth;
 }
 
+void CellGrid3D::SetLayout(enum Layout layout)
+{
+	m_layout = layout;
+	if (m_data)
+		SetSize(m_width, m_height, m_depth);
+}
+
+enum CellGrid3D::Layout CellGrid3D::GetLayout() const
+{
+	return m_layout;
+}
+
+void CellGrid3D::SetStorageFile(const std::string &filename)
+{
+	m_storageFile = filename;
+	if (m_data)
+		SetSize(m_width, m_height, m_depth);
+}
+
+bool CellGrid3D::IsMapped() const
+{
+	return m_mapped;
+}
+
+void CellGrid3D::SetPages(enum Pages pages)
+{
+	m_pages = pages;
+	if (m_data)
+		SetSize(m_width, m_height, m_depth);
+}
+
+enum CellGrid3D::Pages CellGrid3D::GetPages() const
+{
+	return m_pages;
+}
+
+void CellGrid3D::SetHalo(int size)
+{
+	m_halo = size;
+	if (m_data)
+		SetSize(m_width, m_height, m_depth);
+}
+
+int CellGrid3D::GetHalo() const
+{
+	return m_halo;
+}
+
+void CellGrid3D::SetBuffered(bool buffered)
+{
+	m_buffered = buffered;
+	if (m_data)
+		SetSize(m_width, m_height, m_depth);
+}
+
+bool CellGrid3D::IsBuffered() const
+{
+	return m_buffered;
+}
+
+void CellGrid3D::Snapshot()
+{
+	if (m_previousData)
+		memcpy(m_previousData, m_data, GetStorageSize());
+}
+
+void CellGrid3D::ResetHalo()
+{
+	// x faces are filled last so they take precedence on the edges (matches ApplyBounds)
+	static const enum Border order[6] = { FRONT, BACK, BOTTOM, TOP, LEFT, RIGHT };
+	for (int i = 0; i < 6; i++)
+	{
+		if (m_boundMode[order[i]] == BORDER)
+			FillHalo(order[i]);
+	}
+}
+
+void CellGrid3D::FillHalo(enum Border border)
+{
+	if (m_halo == 0 || m_data == NULL)
+		return;
+	
+	int x0 = -m_halo, x1 = m_width + m_halo;
+	int y0 = -m_halo, y1 = m_height + m_halo;
+	int z0 = -m_halo, z1 = m_depth + m_halo;
+	switch (border)
+	{
+		case LEFT:		x1 = 0;			break;
+		case RIGHT:		x0 = m_width;	break;
+		case BOTTOM:	y1 = 0;			break;
+		case TOP:		y0 = m_height;	break;
+		case FRONT:		z1 = 0;			break;
+		case BACK:		z0 = m_depth;	break;
+	}
+	
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			if (m_strideZ == 1)
+				memset(m_cells + ConvertIndex(x, y, z0), m_border[border], z1 - z0);
+			else
+			{
+				for (int z = z0; z < z1; z++)
+					m_cells[ConvertIndex(x, y, z)] = m_border[border];
+			}
+		}
+	}
+}
+
 void CellGrid3D::SetBoundMode(enum BoundMode mode, char option)
 {
 	for (int i = 0; i < 6; i++)
@@ -98,6 +390,7 @@ void CellGrid3D::SetBoundMode(enum BoundMode mode, char option)
 	{
 		for (int i = 0; i < 6; i++)
 			m_border[i] = option;
+		ResetHalo();
 	}
 }
 
@@ -105,7 +398,10 @@ void CellGrid3D::SetBoundMode(enum BoundMode mode, enum Border border, char opti
 {
 	m_boundMode[border] = mode;
 	if (mode == BORDER)
+	{
 		m_border[border] = option;
+		ResetHalo();
+	}
 }
 
 void CellGrid3D::SetBoundMode(const std::string &mode, enum Border border)
@@ -120,6 +416,7 @@ void CellGrid3D::SetBoundMode(const std::string &mode, enum Border border)
 	{
 		m_boundMode[border] = BORDER;
 		m_border[border] = mode[7];
+		ResetHalo();
 	}
 }
 
@@ -128,50 +425,69 @@ enum CellGrid3D::BoundMode CellGrid3D::GetBoundMode(enum Border border) const
 	return m_boundMode[border];
 }
 
-bool CellGrid3D::ApplyBounds(int &x, int &y, int &z) const
+char CellGrid3D::GetBorderValue(enum Border border) const
 {
-	if (x >= m_width || x < 0)
-	{
-		int b = x < 0 ? LEFT : RIGHT;
-		if (m_boundMode[b] == BORDER)
-			return m_border[b];
-		else if (m_boundMode[b] == WRAP)
-			x = Wrap(x, 1, m_width - 1);
-		else if (m_boundMode[b] == EXCEPTION)
-			throw std::out_of_range("Invalid cell index");
-		else
-			return true;
-	}
-	if (y >= m_height || y < 0)
+	return m_border[border];
+}
+
+enum BoundPolicyType CellGrid3D::GetBoundPolicy(enum Axis axis, int reach) const
+{
+	static const enum Border low[3] = { LEFT, BOTTOM, FRONT };
+	static const enum Border high[3] = { RIGHT, TOP, BACK };
+	
+	enum BoundMode mode = m_boundMode[low[axis]];
+	if (mode != m_boundMode[high[axis]])
+		return RUNTIME_BOUND;
+	
+	int size = (axis == X_AXIS) ? m_width : (axis == Y_AXIS) ? m_height : m_depth;
+	switch (mode)
 	{
-		int b = y < 0 ? BOTTOM : TOP;
-		if (m_boundMode[b] == BORDER)
-			return m_border[b];
-		else if (m_boundMode[b] == WRAP)
-			y = Wrap(y, 1, m_height - 1);
-		else if (m_boundMode[b] == EXCEPTION)
-			throw std::out_of_range("Invalid cell index");
-		else
-			return true;
+		case WRAP:
+			return (reach <= size) ? WRAP_BOUND : RUNTIME_BOUND;
+		case EXCEPTION:
+			return EXCEPTION_BOUND;
+		default:
+			return (reach <= m_halo) ? HALO_BOUND : RUNTIME_BOUND;
 	}
-	if (z >= m_depth || z < 0)
+}
+
+bool CellGrid3D::ApplyBound(int &i, int size, enum Border low, enum Border high) const
+{
+	int b = i < 0 ? low : high;
+	switch (m_boundMode[b])
 	{
-		int b = z < 0 ? FRONT : BACK;
-		if (m_boundMode[b] == BORDER)
-			return m_border[b];
-		else if (m_boundMode[b] == WRAP)
-			z = Wrap(z, 1, m_depth - 1);
-		else if (m_boundMode[b] == EXCEPTION)
+		case WRAP:
+			i = ((i % size) + size) % size;
+			return false;
+		case EXCEPTION:
 			throw std::out_of_range("Invalid cell index");
-		else
-			return true;
+		case BORDER:
+			m_dummy = m_border[b];
+			break;
+		case IGNORE:
+			break;
 	}
+	
+	// Cells inside the halo are stored, any further out are redirected to the dummy cell
+	return i < -m_halo || i >= size + m_halo;
+}
+
+bool CellGrid3D::ApplyBounds(int &x, int &y, int &z) const
+{
+	if ((x >= m_width || x < 0) && ApplyBound(x, m_width, LEFT, RIGHT))
+		return true;
+	if ((y >= m_height || y < 0) && ApplyBound(y, m_height, BOTTOM, TOP))
+		return true;
+	if ((z >= m_depth || z < 0) && ApplyBound(z, m_depth, FRONT, BACK))
+		return true;
 	return false;
 }
 
-int CellGrid3D::ConvertIndex(int x, int y, int z) const
+long CellGrid3D::ConvertIndex(int x, int y, int z) const
 {
-	return y * m_width * m_depth + x * m_depth + z;
+	if (m_layout == BRICKS)
+		return m_brickY[y] + m_brickX[x] + m_brickZ[z];
+	return y * m_strideY + x * m_strideX + z * m_strideZ;
 }
 
 char& CellGrid3D::operator()(int x, int y, int z)
@@ -198,26 +514,97 @@ char CellGrid3D::operator()(const Vector3 &position) const
 	return (*this)(position.x, position.y, position.z);
 }
 
+CellOffset CellGrid3D::GetOffset(int x, int y, int z) const
+{
+	CellOffset offset = { x, y, z, ConvertIndex(x, y, z) };
+	return offset;
+}
+
+char& CellGrid3D::Neighbour(int x, int y, int z, const CellOffset &offset)
+{
+	return (*this)(x + offset.x, y + offset.y, z + offset.z);
+}
+
+char& CellGrid3D::Previous(int x, int y, int z)
+{
+	bool ignore = ApplyBounds(x, y, z);
+	if (ignore) return m_dummy;
+	return m_previous[ConvertIndex(x, y, z)];
+}
+
 void CellGrid3D::Fill(char value)
 {
-	for (int y = 0; y < m_height; y++)
+	Fill(value, 0, m_width);
+}
+
+void CellGrid3D::Fill(char value, int x0, int x1)
+{
+	if (m_layout == BRICKS)
 	{
-		for (int x = 0; x < m_width; x++)
+		for (int x = x0; x < x1; x++)
+		{
+			for (int z = 0; z < m_depth; z++)
+			{
+				for (int y = 0; y < m_height; y++)
+					m_cells[ConvertIndex(x, y, z)] = value;
+			}
+		}
+		return;
+	}
+	
+	if (m_layout == COLUMNS)
+	{
+		for (int x = x0; x < x1; x++)
 		{
 			for (int z = 0; z < m_depth; z++)
-				m_cells[ConvertIndex(x, y, z)] = value;
+				memset(m_cells + ConvertIndex(x, 0, z), value, m_height);
 		}
+		return;
+	}
+	
+	for (int y = 0; y < m_height; y++)
+	{
+		for (int x = x0; x < x1; x++)
+			memset(m_cells + ConvertIndex(x, y, 0), value, m_depth);
 	}
 }
 
+void CellGrid3D::ShiftDown(int x, int y, int z)
+{
+	for (int i = y - 1; i < m_height; i++)
+		(*this)(x, i, z) = (*this)(x, i + 1, z);
+}
+
 void CellGrid3D::Fill(int x, int y, int z, int width, int height, int depth, char value)
 {
-	for (int cy = y; cy < y + height; cy++)
+	// The part inside the grid as a region, the rest through the bounds logic (every
+	// cell gets the same value, so the order cells wrap onto each other in is irrelevant)
+	int x0 = Max(x, 0), x1 = Min(x + width, m_width);
+	int y0 = Max(y, 0), y1 = Min(y + height, m_height);
+	int z0 = Max(z, 0), z1 = Min(z + depth, m_depth);
+	if (x0 >= x1 || y0 >= y1 || z0 >= z1)
+	{
+		FillCells(x, y, z, x + width, y + height, z + depth, value);
+		return;
+	}
+	
+	CellRegion3D(*this, x0, y0, z0, x1 - x0, y1 - y0, z1 - z0).Fill(value);
+	FillCells(x, y, z, x + width, y0, z + depth, value);
+	FillCells(x, y1, z, x + width, y + height, z + depth, value);
+	FillCells(x, y0, z, x0, y1, z + depth, value);
+	FillCells(x1, y0, z, x + width, y1, z + depth, value);
+	FillCells(x0, y0, z, x1, y1, z0, value);
+	FillCells(x0, y0, z1, x1, y1, z + depth, value);
+}
+
+void CellGrid3D::FillCells(int x0, int y0, int z0, int x1, int y1, int z1, char value)
+{
+	for (int y = y0; y < y1; y++)
 	{
-		for (int cx = x; cx < x + width; cx++)
+		for (int x = x0; x < x1; x++)
 		{
-			for (int cz = z; cz < z + depth; cz++)
-				(*this)(cx, cy, cz) = value;
+			for (int z = z0; z < z1; z++)
+				(*this)(x, y, z) = value;
 		}
 	}
 }
@@ -227,9 +614,28 @@ void CellGrid3D::Fill(const Vector3 &position, const Vector3 &dimensions, char v
 	Fill(position.x, position.y, position.z, ceil(dimensions.x), ceil(dimensions.y), ceil(dimensions.z), value);
 }
 
+void CellGrid3D::Match(int x, int y, const std::string &values, std::vector<unsigned long long> &mask) const
+{
+	bool match[256] = { false };
+	for (unsigned int i = 0; i < values.size(); i++)
+		match[(unsigned char)values[i]] = true;
+	
+	mask.assign((m_depth + 63) / 64, 0);
+	if (m_layout == BRICKS)
+	{
+		for (int z = 0; z < m_depth; z++)
+			mask[z / 64] |= (unsigned long long)match[(unsigned char)m_cells[ConvertIndex(x, y, z)]] << (z % 64);
+		return;
+	}
+	
+	const char *line = m_cells + ConvertIndex(x, y, 0);
+	for (int z = 0; z < m_depth; z++)
+		mask[z / 64] |= (unsigned long long)match[(unsigned char)line[z * m_strideZ]] << (z % 64);
+}
+
 char* CellGrid3D::GetRow(int index)
 {
-	return m_cells + index * m_width * m_depth;
+	return m_cells + index * m_strideY;
 }
 
 char* CellGrid3D::GetRawData()
@@ -237,19 +643,163 @@ char* CellGrid3D::GetRawData()
 	return m_cells;
 }
 
-void CellGrid3D::CopyCells(char *cellData, int w, int h, int d, int x, int y, int z)
+char* CellGrid3D::GetPreviousData()
+{
+	return m_previous;
+}
+
+char* CellGrid3D::GetStorage()
+{
+	return m_data;
+}
+
+long CellGrid3D::GetStorageSize() const
+{
+	if (m_layout == BRICKS)
+		return (long)m_brickOffsets[X_AXIS].size() * m_brickOffsets[Y_AXIS].size() * m_brickOffsets[Z_AXIS].size();
+	return (long)(m_width + 2 * m_halo) * (m_height + 2 * m_halo) * (m_depth + 2 * m_halo);
+}
+
+long CellGrid3D::GetStrideX() const
+{
+	return m_strideX;
+}
+
+long CellGrid3D::GetStrideY() const
+{
+	return m_strideY;
+}
+
+long CellGrid3D::GetStrideZ() const
+{
+	return m_strideZ;
+}
+
+long CellGrid3D::GetIndex(int x, int y, int z) const
+{
+	return ConvertIndex(x, y, z);
+}
+
+const long* CellGrid3D::GetBrickOffsets(enum Axis axis) const
+{
+	switch (axis)
+	{
+		case X_AXIS: return m_brickX;
+		case Y_AXIS: return m_brickY;
+		default: return m_brickZ;
+	}
+}
+
+void CellGrid3D::CopyCells(const char *cellData, int w, int h, int d, int x, int y, int z)
+{
+	CellRegion3D(*this, x, y, z, w, h, d).Unpack(cellData);
+}
+
+void CellGrid3D::CopyCells(const char *cellData, const Vector3 &dimensions, const Vector3 &position)
+{
+	CopyCells(cellData, dimensions.x, dimensions.y, dimensions.z, position.x, position.y, position.z);
+}
+
+void CellGrid3D::ExtractCells(char *cellData, int w, int h, int d, int x, int y, int z)
+{
+	CellRegion3D(*this, x, y, z, w, h, d).Pack(cellData);
+}
+
+CellRegion3D::CellRegion3D(CellGrid3D &grid, int x, int y, int z, int width, int height, int depth)
+{
+	m_cells = grid.GetRawData();
+	m_width = width;
+	m_height = height;
+	m_depth = depth;
+	m_linesY = grid.GetLayout() == CellGrid3D::COLUMNS;
+	m_linesZ = grid.GetLayout() == CellGrid3D::ROWS;
+	
+	assert(x >= -grid.GetHalo() && x + width <= grid.GetWidth() + grid.GetHalo());
+	assert(y >= -grid.GetHalo() && y + height <= grid.GetHeight() + grid.GetHalo());
+	assert(z >= -grid.GetHalo() && z + depth <= grid.GetDepth() + grid.GetHalo());
+	
+	m_offsetX.resize(width);
+	m_offsetY.resize(height);
+	m_offsetZ.resize(depth);
+	
+	// Cell (0, 0, 0) is at offset 0 in every layout, so the offsets of the axes add up to the
+	// offset of a cell
+	for (int i = 0; i < width; i++)
+		m_offsetX[i] = grid.GetIndex(x + i, 0, 0);
+	for (int i = 0; i < height; i++)
+		m_offsetY[i] = grid.GetIndex(0, y + i, 0);
+	for (int i = 0; i < depth; i++)
+		m_offsetZ[i] = grid.GetIndex(0, 0, z + i);
+}
+
+void CellRegion3D::Fill(char value) const
 {
-	for (int yy = 0; yy < h; yy++)
+	if (GetSize() == 0)
+		return;
+	
+	if (m_linesY)
+	{
+		for (int x = 0; x < m_width; x++)
+		{
+			for (int z = 0; z < m_depth; z++)
+				memset(&(*this)(x, 0, z), value, m_height);
+		}
+		return;
+	}
+	
+	for (int y = 0; y < m_height; y++)
 	{
-		for (int xx = 0; xx < w; xx++)
+		for (int x = 0; x < m_width; x++)
 		{
-			for (int zz = 0; zz < d; zz++)
-				m_cells[ConvertIndex(xx + x, yy + y, zz + z)] = cellData[ConvertIndex(xx, yy, zz)];
+			if (m_linesZ)
+				memset(&(*this)(x, y, 0), value, m_depth);
+			else
+			{
+				for (int z = 0; z < m_depth; z++)
+					(*this)(x, y, z) = value;
+			}
 		}
 	}
 }
 
-void CellGrid3D::CopyCells(char *cellData, const Vector3 &dimensions, const Vector3 &position)
+void CellRegion3D::Pack(char *buffer) const
 {
-	CopyCells(cellData, dimensions.x, dimensions.y, dimensions.z, position.x, position.y, position.z);
+	if (GetSize() == 0)
+		return;
+	
+	for (int y = 0; y < m_height; y++)
+	{
+		for (int x = 0; x < m_width; x++)
+		{
+			if (m_linesZ)
+				memcpy(buffer, &(*this)(x, y, 0), m_depth);
+			else
+			{
+				for (int z = 0; z < m_depth; z++)
+					buffer[z] = (*this)(x, y, z);
+			}
+			buffer += m_depth;
+		}
+	}
+}
+
+void CellRegion3D::Unpack(const char *buffer) const
+{
+	if (GetSize() == 0)
+		return;
+	
+	for (int y = 0; y < m_height; y++)
+	{
+		for (int x = 0; x < m_width; x++)
+		{
+			if (m_linesZ)
+				memcpy(&(*this)(x, y, 0), buffer, m_depth);
+			else
+			{
+				for (int z = 0; z < m_depth; z++)
+					(*this)(x, y, z) = buffer[z];
+			}
+			buffer += m_depth;
+		}
+	}
 }
@@ -14,6 +14,50 @@
  *					if this is not caught the program will abort.
  *				- Ignore: all coordinates outside the border will be ignored. Get will
  *					return an undefined value. Set will have no effect.
+ *			SetHalo(n) pads the storage with a ghost halo n cells deep around the grid.
+ *			Border faces of the halo hold the border value and ignore faces act as a sink,
+ *			so accesses that stay within the halo need no bounds logic at all.
+ *			CellView3D fixes the bound policy of each axis at compile time (see
+ *			BoundPolicy.h). DispatchBounds() selects the matching view for a grid's
+ *			runtime bound modes and passes it to a function object, along with an
+ *			unchecked view for columns whose neighbourhood lies inside the grid.
+ *			By default cells are stored in anonymous memory pages, which the OS only
+ *			places in memory when they are first written - on a NUMA system, in the
+ *			memory of the processor running the writing thread. Filling bands of columns
+ *			from the threads that will update them (see Fill(value, x0, x1)) spreads the
+ *			grid over the processors. SetPages() asks for huge pages, reducing TLB misses
+ *			on large grids: TRANSPARENT_HUGE_PAGES lets the kernel use them where it can,
+ *			HUGE_PAGES takes them from the reserved pool (transparent ones if the pool is
+ *			empty). SetStorageFile() places the cells in a
+ *			memory-mapped file instead, so grids larger than physical memory can be used
+ *			with the OS paging cells in and out as they are accessed. The file is removed
+ *			as soon as it is mapped (it is scratch space, not a saved grid - see
+ *			Checkpoint.h), so it should be on a local disk with enough free space.
+ *			Offsets into the storage are 64-bit.
+ *			SetLayout() selects the order of cells in memory:
+ *				- ROWS (default): each x/z plane (row) after the other, cells along z
+ *					contiguous.
+ *				- COLUMNS: each x/z column after the other, cells along y contiguous, so
+ *					a column shifted down by ShiftDown() is a single memmove and a top
+ *					to bottom sweep of a column is unit-stride.
+ *				- BRICKS: 8x8x8 bricks of cells, each brick's cells in Morton (Z) order
+ *					and the bricks of each x/z column of bricks after each other, so a
+ *					cell's whole neighbourhood lies within a few bricks. The storage is
+ *					padded to whole bricks (halo included). Cells are not a fixed
+ *					distance apart along any axis, so views find them through offset
+ *					tables of each axis (see BrickLayout) and only the unchecked
+ *					interior view is specialised (see DispatchBounds()). Tiles of
+ *					whole brick columns (see TileSchedule) give each brick column its
+ *					own activity flag.
+ *			SetBuffered() adds a second buffer for synchronous updates (see CellRules):
+ *			Snapshot() copies the whole storage into it, and Previous() accesses the
+ *			cells as they were at the last snapshot while the grid itself is updated.
+ *			The second buffer is never in a storage file.
+ *			CellRegion3D is a view of a box of cells for bulk operations: Fill(), and
+ *			Pack()/Unpack() to and from a dense buffer, move whole lines with memset and
+ *			memcpy where the layout keeps them contiguous. Fill(x, y, z, w, h, d, value),
+ *			CopyCells() and ExtractCells() go through it, so filling regions of a large
+ *			grid and reassembling MPI sectors need no per-cell bounds logic.
  * @author	Matt Drage
  * @date	27/12/2012
  */
@@ -22,13 +66,33 @@
 #define CELLGRID3D_H
 
 #include "Vector3.h"
+#include "BoundPolicy.h"
 #include <string>
+#include <vector>
+#include <cstring>
+
+// Offset from a cell to a neighbour, with the distance between them in the grid's
+// storage (see CellGrid3D::GetOffset())
+struct CellOffset
+{
+	int x, y, z;
+	long delta;
+};
+typedef struct CellOffset CellOffset;
+
+class CellRegion3D;
 
 class CellGrid3D
 {
 	public:
 		enum BoundMode { BORDER, WRAP, EXCEPTION, IGNORE };
 		enum Border { LEFT = 0, RIGHT = 1, TOP = 2, BOTTOM = 3, FRONT = 4, BACK = 5 };
+		enum Axis { X_AXIS, Y_AXIS, Z_AXIS };
+		enum Layout { ROWS, COLUMNS, BRICKS };
+		enum Pages { NORMAL_PAGES, TRANSPARENT_HUGE_PAGES, HUGE_PAGES };
+	
+		// Cells along each side of a brick (BRICKS layout)
+		static const int BRICK_SIZE = 8;
 	
 		// Constructors & Destructors
 		CellGrid3D();
@@ -43,11 +107,37 @@ class CellGrid3D
 		int GetHeight() const;
 		int GetDepth() const;
 	
+		// Cell storage - anonymous pages if the filename is empty, otherwise a
+		// memory-mapped file (reallocates the grid, so set it before filling)
+		void SetStorageFile(const std::string &filename);
+		bool IsMapped() const;
+	
+		// Page size of anonymous storage (reallocates the grid, so set it before filling)
+		void SetPages(enum Pages pages);
+		enum Pages GetPages() const;
+	
+		// Order of cells in memory (reallocates the grid, so set it before filling)
+		void SetLayout(enum Layout layout);
+		enum Layout GetLayout() const;
+	
+		// Ghost halo (reallocates the grid, so set it before filling)
+		void SetHalo(int size);
+		int GetHalo() const;
+		void ResetHalo();
+	
+		// Second buffer for synchronous updates (reallocates the grid, so set it before
+		// filling)
+		void SetBuffered(bool buffered);
+		bool IsBuffered() const;
+		void Snapshot();
+	
 		// Bound modes
 		void SetBoundMode(enum BoundMode mode, char option = 0);
 		void SetBoundMode(enum BoundMode mode, enum Border border, char option = 0);
 		void SetBoundMode(const std::string &mode, enum Border border);
 		enum BoundMode GetBoundMode(enum Border border) const;
+		char GetBorderValue(enum Border border) const;
+		enum BoundPolicyType GetBoundPolicy(enum Axis axis, int reach) const;
 	
 		// Cell access
 		char& operator()(int x, int y, int z);
@@ -55,31 +145,324 @@ class CellGrid3D
 		char& operator()(const Vector3 &position);
 		char operator()(const Vector3 &position) const;
 	
+		// Offset to a neighbour for the current size, halo and layout, and the neighbour
+		// of cell (x, y, z) at that offset
+		CellOffset GetOffset(int x, int y, int z) const;
+		char& Neighbour(int x, int y, int z, const CellOffset &offset);
+	
+		// Cell access in the second buffer (see SetBuffered())
+		char& Previous(int x, int y, int z);
+	
 		// Cell value initialisation
 		void Fill(char value);
+		void Fill(char value, int x0, int x1);	// columns [x0, x1)
 		void Fill(int x, int y, int z, int width, int height, int depth, char value);
 		void Fill(const Vector3 &position, const Vector3 &dimensions, char value);
 	
+		// Move cells (x, y..height, z) down one cell, y - 1 to height - 1 take the
+		// values above them (the halo cell above the top is copied too)
+		void ShiftDown(int x, int y, int z);
+	
+		// Set bit z of mask for each cell (x, y, z) of a line inside the grid holding one
+		// of values
+		void Match(int x, int y, const std::string &values, std::vector<unsigned long long> &mask) const;
+	
 		// Raw data access
+		// Pointer to cell (0, 0, 0) - with a halo, x lines and rows are not contiguous
+		// GetRow() is only valid for the ROWS layout
 		char* GetRow(int index);
 		char* GetRawData();
+		char* GetPreviousData();
+	
+		// Distance between neighbouring cells along each axis, 0 for the BRICKS layout
+		long GetStrideX() const;
+		long GetStrideY() const;
+		long GetStrideZ() const;
 	
-		// Copy cell data
-		void CopyCells(char *cellData, int w, int h, int d, int x, int y, int z);
-		void CopyCells(char *cellData, const Vector3 &dimensions, const Vector3 &position);
+		// Offset of cell (x, y, z) from GetRawData() for any layout, without bounds logic
+		// (valid inside the grid and halo)
+		long GetIndex(int x, int y, int z) const;
+	
+		// BRICKS layout: offsets from GetRawData() along one axis, indexed from -halo
+		const long* GetBrickOffsets(enum Axis axis) const;
+	
+		// Whole allocation including the halo, GetStorageSize() bytes
+		char* GetStorage();
+		long GetStorageSize() const;
+	
+		// Copy cell data to and from a dense buffer ordered y, x, z (z fastest) - the box
+		// must lie inside the grid and halo (see CellRegion3D)
+		void CopyCells(const char *cellData, int w, int h, int d, int x, int y, int z);
+		void CopyCells(const char *cellData, const Vector3 &dimensions, const Vector3 &position);
+		void ExtractCells(char *cellData, int w, int h, int d, int x, int y, int z);
 	
 	private:
 		void InitBorders();
+		void Release();
+		char* AllocatePages(long size, long &length) const;
 		bool ApplyBounds(int &x, int &y, int &z) const;
-		int ConvertIndex(int x, int y, int z) const;
+		bool ApplyBound(int &i, int size, enum Border low, enum Border high) const;
+		long ConvertIndex(int x, int y, int z) const;
+		long CreateBrickOffsets(std::vector<long> &offsets, int size, int shift, long brickStride);
+		void FillHalo(enum Border border);
+		void FillCells(int x0, int y0, int z0, int x1, int y1, int z1, char value);
 	
 		int m_width;
 		int m_height;
 		int m_depth;
+		int m_halo;
+		long m_strideX;
+		long m_strideY;
+		long m_strideZ;
+		enum Layout m_layout;
+		std::vector<long> m_brickOffsets[3];
+		const long *m_brickX;
+		const long *m_brickY;
+		const long *m_brickZ;
+		std::string m_storageFile;
+		bool m_mapped;
+		long m_mappedSize;
+		long m_previousSize;
+		enum Pages m_pages;
+		bool m_buffered;
 		char m_border[6];
 		enum BoundMode m_boundMode[6];
+		char *m_data;
+		char *m_cells;
+		char *m_previousData;
+		char *m_previous;
+		mutable char m_dummy;
+};
+
+// Storage offsets of the ROWS and COLUMNS layouts, a fixed stride along each axis
+class StridedLayout
+{
+	public:
+		static const bool LINEAR = true;
+	
+		StridedLayout(CellGrid3D &grid)
+		{
+			m_strideX = grid.GetStrideX();
+			m_strideY = grid.GetStrideY();
+			m_strideZ = grid.GetStrideZ();
+		}
+	
+		long X(int x) const { return x * m_strideX; }
+		long Y(int y) const { return y * m_strideY; }
+		long Z(int z) const { return z * m_strideZ; }
+		bool IsColumnContiguous() const { return m_strideY == 1; }
+	
+	private:
+		long m_strideX;
+		long m_strideY;
+		long m_strideZ;
+};
+
+// Storage offsets of the BRICKS layout, looked up per axis
+class BrickLayout
+{
+	public:
+		static const bool LINEAR = false;
+	
+		BrickLayout(CellGrid3D &grid)
+		{
+			m_offsetX = grid.GetBrickOffsets(CellGrid3D::X_AXIS);
+			m_offsetY = grid.GetBrickOffsets(CellGrid3D::Y_AXIS);
+			m_offsetZ = grid.GetBrickOffsets(CellGrid3D::Z_AXIS);
+		}
+	
+		long X(int x) const { return m_offsetX[x]; }
+		long Y(int y) const { return m_offsetY[y]; }
+		long Z(int z) const { return m_offsetZ[z]; }
+		bool IsColumnContiguous() const { return false; }
+	
+	private:
+		const long *m_offsetX;
+		const long *m_offsetY;
+		const long *m_offsetZ;
+};
+
+// Box of cells (x, y, z) to (x + width, y + height, z + depth) of a grid, addressed
+// from its corner without bounds logic - the box must lie inside the grid and halo.
+// Each axis has a table of storage offsets, so every layout is handled alike; lines
+// along z (ROWS) or y (COLUMNS) are contiguous and moved with memset/memcpy.
+// Pack() and Unpack() use a dense buffer ordered y, x, z (z fastest).
+class CellRegion3D
+{
+	public:
+		CellRegion3D(CellGrid3D &grid, int x, int y, int z, int width, int height, int depth);
+	
+		int GetWidth() const { return m_width; }
+		int GetHeight() const { return m_height; }
+		int GetDepth() const { return m_depth; }
+		long GetSize() const { return (long)m_width * m_height * m_depth; }
+	
+		// Cell (x, y, z) relative to the corner of the box
+		char& operator()(int x, int y, int z) const
+		{
+			return m_cells[m_offsetY[y] + m_offsetX[x] + m_offsetZ[z]];
+		}
+	
+		void Fill(char value) const;
+		void Pack(char *buffer) const;
+		void Unpack(const char *buffer) const;
+	
+	private:
+		char *m_cells;
+		int m_width;
+		int m_height;
+		int m_depth;
+		bool m_linesY;
+		bool m_linesZ;
+		std::vector<long> m_offsetX;
+		std::vector<long> m_offsetY;
+		std::vector<long> m_offsetZ;
+};
+
+// Cell access with the bound policy of each axis (and the storage layout) fixed at
+// compile time
+template<typename XPolicy, typename YPolicy, typename ZPolicy, typename Layout = StridedLayout>
+class CellView3D
+{
+	public:
+		typedef XPolicy XBound;
+		typedef YPolicy YBound;
+		typedef ZPolicy ZBound;
+	
+		CellView3D(CellGrid3D &grid) : m_layout(grid)
+		{
+			m_cells = grid.GetRawData();
+			m_previous = grid.GetPreviousData();
+			m_width = grid.GetWidth();
+			m_height = grid.GetHeight();
+			m_depth = grid.GetDepth();
+		}
+	
+		int GetWidth() const { return m_width; }
+		int GetHeight() const { return m_height; }
+		int GetDepth() const { return m_depth; }
+	
+		long Offset(int x, int y, int z) const
+		{
+			return m_layout.Y(YBound::Apply(y, m_height)) + m_layout.X(XBound::Apply(x, m_width)) + m_layout.Z(ZBound::Apply(z, m_depth));
+		}
+	
+		char& operator()(int x, int y, int z) const
+		{
+			return m_cells[Offset(x, y, z)];
+		}
+	
+		char& operator()(const Vector3 &position) const
+		{
+			return m_cells[Offset(position.x, position.y, position.z)];
+		}
+	
+		// Neighbour of (x, y, z) - a single indexed access when no axis has bounds logic
+		char& Neighbour(int x, int y, int z, const CellOffset &offset) const
+		{
+			if (Layout::LINEAR && XBound::LINEAR && YBound::LINEAR && ZBound::LINEAR)
+				return m_cells[Offset(x, y, z) + offset.delta];
+			return m_cells[Offset(x + offset.x, y + offset.y, z + offset.z)];
+		}
+	
+		// Cell (x, y, z) in the grid's second buffer (see CellGrid3D::SetBuffered())
+		char& Previous(int x, int y, int z) const
+		{
+			return m_previous[Offset(x, y, z)];
+		}
+	
+		// See CellGrid3D::ShiftDown() - a memmove if the column is contiguous and the cell
+		// above the top is in the halo
+		void ShiftDown(int x, int y, int z) const
+		{
+			if (m_layout.IsColumnContiguous() && y > 0 && YBound::Apply(m_height, m_height) == m_height)
+			{
+				char *cell = m_cells + Offset(x, y - 1, z);
+				memmove(cell, cell + 1, m_height - y + 1);
+				return;
+			}
+			
+			for (int i = y - 1; i < m_height; i++)
+				(*this)(x, i, z) = (*this)(x, i + 1, z);
+		}
+	
+	private:
+		Layout m_layout;
 		char *m_cells;
-		char m_dummy;
+		char *m_previous;
+		int m_width;
+		int m_height;
+		int m_depth;
 };
 
+template<typename XBound, typename YBound, typename ZBound, typename Func>
+void InvokeCellView3D(CellGrid3D &grid, Func &func)
+{
+	CellView3D<XBound, YBound, ZBound> edge(grid);
+	CellView3D<HaloBound, YBound, HaloBound> interior(grid);
+	func(edge, interior);
+}
+
+template<typename XBound, typename YBound, typename Func>
+void DispatchBoundsZ(CellGrid3D &grid, Func &func, enum BoundPolicyType z)
+{
+	switch (z)
+	{
+		case WRAP_BOUND: InvokeCellView3D<XBound, YBound, WrapBound>(grid, func); break;
+		case HALO_BOUND: InvokeCellView3D<XBound, YBound, HaloBound>(grid, func); break;
+		case EXCEPTION_BOUND: InvokeCellView3D<XBound, YBound, ExceptionBound>(grid, func); break;
+		default: func(grid, grid); break;
+	}
+}
+
+template<typename XBound, typename Func>
+void DispatchBoundsY(CellGrid3D &grid, Func &func, enum BoundPolicyType y, enum BoundPolicyType z)
+{
+	switch (y)
+	{
+		case WRAP_BOUND: DispatchBoundsZ<XBound, WrapBound>(grid, func, z); break;
+		case HALO_BOUND: DispatchBoundsZ<XBound, HaloBound>(grid, func, z); break;
+		case EXCEPTION_BOUND: DispatchBoundsZ<XBound, ExceptionBound>(grid, func, z); break;
+		default: func(grid, grid); break;
+	}
+}
+
+// Call func(edge, interior) with views matching the grid's bound modes.
+// The reach parameters give how far outside the grid func may access along each axis.
+// 'interior' performs no bounds logic on x and z, so is only valid for columns at least
+// reachX/reachZ cells away from the left/right and front/back borders.
+// Falls back to func(grid, grid) if an axis has no matching compile-time policy.
+// A BRICKS grid only gets a bricked interior view (if y needs no bounds logic), its
+// edge columns use the grid itself - this keeps the number of views compiled down.
+template<typename Func>
+void DispatchBounds(CellGrid3D &grid, Func &func, int reachX, int reachY, int reachZ)
+{
+	// Border values written into the halo during the last call are restored
+	grid.ResetHalo();
+	
+	enum BoundPolicyType x = grid.GetBoundPolicy(CellGrid3D::X_AXIS, reachX);
+	enum BoundPolicyType y = grid.GetBoundPolicy(CellGrid3D::Y_AXIS, reachY);
+	enum BoundPolicyType z = grid.GetBoundPolicy(CellGrid3D::Z_AXIS, reachZ);
+	
+	if (grid.GetLayout() == CellGrid3D::BRICKS)
+	{
+		if (y == HALO_BOUND)
+		{
+			CellView3D<HaloBound, HaloBound, HaloBound, BrickLayout> interior(grid);
+			func(grid, interior);
+		}
+		else
+			func(grid, grid);
+		return;
+	}
+	
+	switch (x)
+	{
+		case WRAP_BOUND: DispatchBoundsY<WrapBound>(grid, func, y, z); break;
+		case HALO_BOUND: DispatchBoundsY<HaloBound>(grid, func, y, z); break;
+		case EXCEPTION_BOUND: DispatchBoundsY<ExceptionBound>(grid, func, y, z); break;
+		default: func(grid, grid); break;
+	}
+}
+
 #endif
@@ -0,0 +1,88 @@
+/*
+ * @file	CellPlane.h
+ * @brief	Presents a 2D cell grid as the plane z = 0 of a 3D grid.
+ * @details	Lets the 2D drivers run the rules of the 3D ones (see CellRules) on a
+ *			CellGrid2D or one of its views (see DispatchBounds()): cell (x, y, 0) is cell
+ *			(x, y) of the 2D grid, and cells in front of or behind the plane read as 0,
+ *			which no rule applies to, so drills only advance along x and collapses only
+ *			test their neighbours along x. Writes to cells off the plane are discarded.
+ *			Neighbourhoods must only hold offsets in the plane (see GenerateSelectionSet()
+ *			for a row of offsets).
+ *			ShiftDown() shifts a column down to the top of the grid, or to the row set
+ *			with SetTop() (e.g. to stop at the top row of a band of rows).
+ * @author	Matt Drage
+ * @date	25/03/2013
+ */
+
+#ifndef CELLPLANE_H
+#define CELLPLANE_H
+
+#include "CellGrid3D.h"
+
+template<typename Grid>
+class CellPlane
+{
+	public:
+		CellPlane(Grid &grid) : m_grid(grid), m_top(grid.GetHeight()), m_keepGap(false), m_outside(0) {}
+	
+		int GetWidth() const { return m_grid.GetWidth(); }
+		int GetHeight() const { return m_grid.GetHeight(); }
+		int GetDepth() const { return 1; }
+	
+		// Shift columns down to row top - 1, reading row top (the top of the grid by
+		// default). With keepGap, row top takes the gap filled instead, so the cells of a
+		// band of rows stay in it and the band above falls into the gap by itself.
+		void SetTop(int top, bool keepGap = false) { m_top = top; m_keepGap = keepGap; }
+	
+		char& operator()(int x, int y, int z)
+		{
+			return (z == 0) ? m_grid(x, y) : Outside();
+		}
+	
+		char& operator()(const Vector3 &position)
+		{
+			return (*this)(position.x, position.y, position.z);
+		}
+	
+		// Cells are found from their coordinates, offsets carry no distance in memory
+		CellOffset GetOffset(int x, int y, int z) const
+		{
+			CellOffset offset = { x, y, z, 0 };
+			return offset;
+		}
+	
+		char& Neighbour(int x, int y, int z, const CellOffset &offset)
+		{
+			return (*this)(x + offset.x, y + offset.y, z + offset.z);
+		}
+	
+		// Cell (x, y, z) in the grid's second buffer (see CellGrid2D::SetBuffered())
+		char& Previous(int x, int y, int z)
+		{
+			return (z == 0) ? m_grid.Previous(x, y) : Outside();
+		}
+	
+		// See CellGrid3D::ShiftDown()
+		void ShiftDown(int x, int y, int z)
+		{
+			char gap = m_grid(x, y - 1);
+			for (int i = y - 1; i < m_top; i++)
+				m_grid(x, i) = m_grid(x, i + 1);
+			if (m_keepGap)
+				m_grid(x, m_top) = gap;
+		}
+	
+	private:
+		char& Outside()
+		{
+			m_outside = 0;
+			return m_outside;
+		}
+	
+		Grid &m_grid;
+		int m_top;
+		bool m_keepGap;
+		char m_outside;
+};
+
+#endif
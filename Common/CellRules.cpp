@@ -0,0 +1,126 @@
+
+#include "CellRules.h"
+#include "MathUtils.h"
+#include <sstream>
+
+CellRules::CellRules()
+{
+	m_originX = 0;
+	m_originY = 0;
+	m_originZ = 0;
+	m_killBubble = NULL;
+	m_jumps = NULL;
+	m_settling = false;
+	m_unsettled = 1;
+	for (int i = 0; i < 256; i++)
+		m_material[i] = 0;
+	Create('v', 's', 'd', "earth air", "coal", "earth", "air static", "air");
+}
+
+void CellRules::Load(Xml &xml)
+{
+	using std::string;
+	Create(xml.Get<char>("Rules/Void", 'v'),
+		xml.Get<char>("Rules/StaticVoid", 's'),
+		xml.Get<char>("Rules/Drill", 'd'),
+		xml.Get<string>("Rules/Passable", "earth air"),
+		xml.Get<string>("Rules/Fuel", "coal"),
+		xml.Get<string>("Rules/Collapsing", "earth"),
+		xml.Get<string>("Rules/Gaps", "air static"),
+		xml.Get<string>("Rules/Air", "air"));
+}
+
+void CellRules::Create(char voidValue, char staticVoid, char drill, const std::string &passable, const std::string &fuel, const std::string &collapsing, const std::string &gaps, const std::string &air)
+{
+	m_void = voidValue;
+	m_staticVoid = staticVoid;
+	m_drill = drill;
+	SetValues(m_passable, passable);
+	SetValues(m_fuel, fuel);
+	SetValues(m_gap, gaps);
+	SetValues(m_air, air);
+
+	bool collapse[256];
+	SetValues(collapse, collapsing);
+	for (int i = 0; i < 256; i++)
+		m_rule[i] = collapse[i] ? COLLAPSE : NONE;
+	m_rule[(unsigned char)m_void] = MOVE;
+	m_rule[(unsigned char)m_drill] = DRILL;
+}
+
+std::string CellRules::GetValues() const
+{
+	std::string values;
+	for (int i = 1; i < 256; i++)
+	{
+		if (m_rule[i] != NONE || m_passable[i] || m_fuel[i] || m_gap[i] || m_air[i] || i == (unsigned char)m_staticVoid)
+			values += (char)i;
+	}
+	return values;
+}
+
+std::string CellRules::GetVoids() const
+{
+	std::string values;
+	values += m_void;
+	values += m_staticVoid;
+	return values;
+}
+
+void CellRules::SetValues(bool *table, const std::string &values)
+{
+	// Words separated by spaces, the first letter of each is a cell value (as in
+	// Grid/DefaultValue)
+	for (int i = 0; i < 256; i++)
+		table[i] = false;
+	std::stringstream ss(values);
+	std::string word;
+	while (ss >> word)
+		table[(unsigned char)word[0]] = true;
+}
+
+void CellRules::SetKillBubble(KillBubble *killBubble)
+{
+	m_killBubble = killBubble;
+}
+
+void CellRules::SetJumps(VoidJumps *jumps)
+{
+	m_jumps = (jumps != NULL && jumps->GetMaxRows() > 1) ? jumps : NULL;
+}
+
+int CellRules::GetMaxRows() const
+{
+	return m_jumps != NULL ? m_jumps->GetMaxRows() : 1;
+}
+
+int CellRules::GetReach(int radius) const
+{
+	int reach = radius * GetMaxRows();
+	if (m_settling)
+		reach = Max(reach, 2 * radius);
+	return Max(reach, 1);
+}
+
+void CellRules::SetOrigin(int x, int y, int z)
+{
+	m_originX = x;
+	m_originY = y;
+	m_originZ = z;
+}
+
+void CellRules::SetSettling(bool settling)
+{
+	m_settling = settling;
+	ResetSettled();
+}
+
+void CellRules::ResetSettled()
+{
+	m_unsettled = !m_settling;
+}
+
+bool CellRules::IsSettled() const
+{
+	return m_settling && !m_unsettled;
+}
@@ -0,0 +1,601 @@
+
+/*
+ * @file	CellRules.h/.cpp
+ * @brief	The subsidence rules of the drivers, compiled from the config file.
+ * @details	Cell states and the rules they follow are listed in an optional Rules element
+ *			of the config file (see README.md). Values are given as words, the first letter
+ *			of each being the cell value (as for Grid/DefaultValue), e.g. "earth air":
+ *				- Void, StaticVoid, Drill: the values of these states.
+ *				- Passable: cells a void may move onto (swapping places with them).
+ *				- Fuel: cells a drill advances through, leaving voids behind.
+ *				- Collapsing: cells that fall when a Gap cell is below them and next to
+ *					them or below them, shifting the column above down.
+ *				- Gaps: cells collapsing cells fall into.
+ *				- Air: the open air above the ground, which voids that have reached
+ *					the surface move through (see IsSettled()).
+ *			Without a Rules element the standard rules are used (earth and air passable,
+ *			coal fuel, earth collapsing into air and static voids). Adding a material is a
+ *			matter of adding its value to the lists.
+ *			Create() compiles the lists into tables indexed by cell value: the rule each
+ *			value follows, and the value sets the rules test against. Update() looks up
+ *			a cell's rule and applies it, reading only table entries - every driver runs
+ *			the same kernel, specialised at compile time for its grid view and for the
+ *			observer it passes (see NoObserver).
+ *			Voids move by one neighbourhood and are killed by one KillBubble, unless the
+ *			value they rise into has its own neighbourhood and kill probability (see
+ *			SetNeighbourhood(), e.g. Composite's materials).
+ *			The 2D drivers apply the same rules to the plane z = 0 (see CellPlane).
+ *			Voids draw their random numbers from the stream of the cell's position in the
+ *			whole grid (SetOrigin() gives the position of a block), so results depend on
+ *			the update order but not on which thread or processor runs an update.
+ *			UpdateSynchronous() runs a synchronous update instead, where every rule
+ *			sees the cells as they were at the start of the iteration (the grid's second
+ *			buffer, see CellGrid3D::SetBuffered()). Each phase is a pass over all the
+ *			cells:
+ *				- PROPOSE: voids pick a target as in the sweep and claim it (or are
+ *					killed), drills advance. A claim is written over the void in the
+ *					second buffer, where other updates read it as a void.
+ *				- RESOLVE: a claimed target goes to the claiming void of highest priority
+ *					(see Random::Hash()), which swaps places with it. The other claimants
+ *					stay where they are.
+ *				- SETTLE: collapsing cells fall, tested against their own column as it
+ *					is now and their neighbours as they were.
+ *			No cell is written by two updates of a phase or read by one update while
+ *			another writes it, so the result of an iteration does not depend on the
+ *			order or the thread of the updates. Voids do not jump in synchronous updates
+ *			and never move onto other voids, and the neighbourhood may hold at most
+ *			MAX_CLAIMS offsets.
+ *			Updates also tell whether an iteration leaves the grid settled (see
+ *			IsSettled()): no drill advances, no cell collapses or is about to, and every
+ *			void has reached the surface or cannot move. Voids in the air trade places
+ *			with it for ever, so the grid settles long before no cell is live.
+ * @author	Matt Drage
+ * @date	25/03/2013
+ */
+
+#ifndef CELLRULES_H
+#define CELLRULES_H
+
+#include <string>
+#include <vector>
+#include "CellGrid3D.h"
+#include "SelectionSet.h"
+#include "KillBubble.h"
+#include "VoidJumps.h"
+#include "Random.h"
+#include "Xml.h"
+
+// Observers are told about every cell a rule changes (Shifted for a column shifted down
+// from y - 1 up) - the sweep has no use for them
+struct NoObserver
+{
+	void Changed(int x, int y, int z) {}
+	void Shifted(int x, int y, int z) {}
+};
+typedef struct NoObserver NoObserver;
+
+class CellRules
+{
+	public:
+		enum Rule { NONE, MOVE, DRILL, COLLAPSE };
+		enum Phase { SWEEP, PROPOSE, RESOLVE, SETTLE };
+		static const int MAX_CLAIMS = 128;
+
+		// Constructors
+		CellRules();
+
+		// Read the Rules element of a config file (if any) and compile the tables. The
+		// lists are words separated by spaces.
+		void Load(Xml &xml);
+		void Create(char voidValue, char staticVoid, char drill, const std::string &passable, const std::string &fuel, const std::string &collapsing, const std::string &gaps, const std::string &air);
+
+		// Every value the rules use, once each
+		std::string GetValues() const;
+
+		// Values a void's move leaves in its new cell (voids, and static voids for jumps)
+		std::string GetVoids() const;
+
+		// Offsets voids move by, for the final size and layout of grid
+		template<typename Grid>
+		void SetNeighbourhood(const Grid &grid, const SelectionSet<Vector3> &selection)
+		{
+			m_neighbourhood.Clear();
+			for (int i = 0; i < selection.GetSetSize(); i++)
+			{
+				const Vector3 &offset = selection.GetValue(i);
+				m_neighbourhood.Add(selection.GetProbability(i), grid.GetOffset(offset.x, offset.y, offset.z));
+			}
+			m_neighbourhood.BuildAliasTable();
+		}
+
+		// Own neighbourhood and kill probability of voids rising into cells of value (the
+		// cell directly above a void decides). These voids only move onto cells of that
+		// value, drawn from the neighbourhood restricted to them, and do not jump. Other
+		// values use the neighbourhood above and the KillBubble. Synchronous updates use
+		// the neighbourhood above for every value.
+		template<typename Grid>
+		void SetNeighbourhood(const Grid &grid, const SelectionSet<Vector3> &selection, char value, float killProbability)
+		{
+			Material material;
+			for (int i = 0; i < selection.GetSetSize(); i++)
+			{
+				const Vector3 &offset = selection.GetValue(i);
+				material.neighbourhood.Add(selection.GetProbability(i), grid.GetOffset(offset.x, offset.y, offset.z));
+			}
+			material.neighbourhood.BuildAliasTable();
+			material.killProbability = killProbability;
+			
+			unsigned char &index = m_material[(unsigned char)value];
+			if (index == 0)
+			{
+				m_materials.push_back(material);
+				index = m_materials.size();
+			}
+			else
+				m_materials[index - 1] = material;
+		}
+
+		// When voids are killed, and (optionally) how they jump through passable cells
+		void SetKillBubble(KillBubble *killBubble);
+		void SetJumps(VoidJumps *jumps);
+		int GetMaxRows() const;
+
+		// Columns away from its own an update may read or write, for a neighbourhood of
+		// the given radius: radius * GetMaxRows(), or 2 * radius while settling is
+		// tracked (a void's new cell is tested against its own neighbourhood), at least 1
+		int GetReach(int radius) const;
+
+		// Position of the grid's cell (0, 0, 0) in the whole grid
+		void SetOrigin(int x, int y, int z);
+
+		// Track whether iterations settle the grid (off by default, when updates skip
+		// the tests and IsSettled() is always false)
+		void SetSettling(bool settling);
+
+		// True if no update since ResetSettled() (called before an iteration, or before a
+		// block of them) left the grid unsettled. A void has reached the surface when none
+		// of the cells it may move onto is a passable cell other than air, and no
+		// collapsing cell would fall into its place - later iterations only move it
+		// through the air. Once the grid has settled, only voids in the air can change.
+		void ResetSettled();
+		bool IsSettled() const;
+
+		// True if a rule may change cell (x, y, z) - for collapsing cells, only with a gap
+		// below them
+		template<typename Grid>
+		bool MayApply(Grid &grid, int x, int y, int z) const
+		{
+			switch (m_rule[(unsigned char)grid(x, y, z)])
+			{
+				case MOVE:
+				case DRILL:
+					return true;
+				case COLLAPSE:
+					return m_gap[(unsigned char)grid(x, y - 1, z)];
+				default:
+					return false;
+			}
+		}
+
+		// Apply the rule of cell (x, y, z). Returns true if the cell is live (see
+		// ActiveTiles) - a cell changed or it is a drill cell or a void that may move.
+		// Voids in the top row either move every time (top border of a passable value) or
+		// never, so they are only live if they move (a wrapped top border is not supported).
+		template<typename Grid, typename Observer>
+		bool Update(Grid &grid, int x, int y, int z, unsigned int iteration, Observer &observer)
+		{
+			switch (m_rule[(unsigned char)grid(x, y, z)])
+			{
+				case MOVE:
+					return UpdateVoid(grid, x, y, z, iteration, observer);
+				case DRILL:
+					UpdateDrill(grid, grid, x, y, z, observer);
+					Unsettle();
+					return true;
+				case COLLAPSE:
+					return UpdateCollapse(grid, x, y, z, observer);
+				default:
+					return false;
+			}
+		}
+
+		// Mine cell (x, y, z) for a mining plan (see MiningPlan) - fuel is left as a void.
+		// Returns true if the cell changed.
+		template<typename Grid, typename Observer>
+		bool Extract(Grid &grid, int x, int y, int z, Observer &observer)
+		{
+			if (!m_fuel[(unsigned char)grid(x, y, z)])
+				return false;
+			
+			grid(x, y, z) = m_void;
+			observer.Changed(x, y, z);
+			return true;
+		}
+
+		// Update a column from top to bottom, returns true if any cell is live
+		template<typename Grid>
+		bool UpdateColumn(Grid &grid, int x, int z, unsigned int iteration)
+		{
+			NoObserver observer;
+			bool live = false;
+			for (int y = grid.GetHeight() - 1; y >= 0; y--)
+				live |= Update(grid, x, y, z, iteration, observer);
+			return live;
+		}
+		
+		// One phase of a synchronous update of cell (x, y, z), returns true if the cell is
+		// live. Every cell runs a phase before any cell runs the next, in any order except
+		// that the cells of a column run SETTLE from top to bottom. The grid must have a
+		// second buffer holding the cells at the start of the iteration.
+		template<typename Grid>
+		bool UpdateSynchronous(Grid &grid, int x, int y, int z, unsigned int iteration, enum Phase phase)
+		{
+			switch (phase)
+			{
+				case PROPOSE:
+					return Propose(grid, x, y, z, iteration);
+				case RESOLVE:
+					return Resolve(grid, x, y, z, iteration);
+				case SETTLE:
+					return Settle(grid, x, y, z);
+				default:
+					return false;
+			}
+		}
+
+	private:
+		static const unsigned char CLAIM = 0x80;
+		
+		// Cells of a grid at the start of a synchronous update, claims read as voids
+		template<typename Grid>
+		class Before
+		{
+			public:
+				Before(Grid &grid, char voidValue) : m_grid(grid), m_void(voidValue) {}
+				
+				char operator()(int x, int y, int z) const
+				{
+					char value = m_grid.Previous(x, y, z);
+					return ((unsigned char)value & CLAIM) ? m_void : value;
+				}
+			
+			private:
+				Grid &m_grid;
+				char m_void;
+		};
+		
+		template<typename Grid, typename Observer>
+		bool UpdateVoid(Grid &grid, int x, int y, int z, unsigned int iteration, Observer &observer)
+		{
+			bool live = y < grid.GetHeight() - 1;
+			Random::SetStream(iteration, m_originX + x, m_originY + y, m_originZ + z);
+			
+			// Rise several rows at once through cells of one passable value - the void ends
+			// up where the same number of single moves would have taken it, or where it
+			// was killed
+			char above = grid(x, y + 1, z);
+			int material = m_material[(unsigned char)above];
+			int rows = (m_jumps != NULL && material == 0 && m_passable[(unsigned char)above]) ? m_jumps->ClearRows(grid, x, y, z, above) : 0;
+			if (rows > 1)
+			{
+				Unsettle();
+				int moves = m_killBubble->Moves(x, y, z, rows);
+				grid(x, y, z) = above;
+				observer.Changed(x, y, z);
+				Vector3 target(x, y, z);
+				if (moves > 0)
+				{
+					target += m_jumps->Select(moves);
+					m_killBubble->Move(x, y, z, target.x, target.y, target.z);
+					observer.Changed(target.x, target.y, target.z);
+				}
+				grid(target) = moves < rows ? m_staticVoid : m_void;
+				return true;
+			}
+			
+			// Offsets carry the distance to the target in memory, so inside the grid a
+			// move is a lookup and an indexed load and store
+			CellOffset offset = material ? SelectOffset(grid, x, y, z, above, m_materials[material - 1].neighbourhood) : m_neighbourhood.RouletteSelect();
+			char target = grid.Neighbour(x, y, z, offset);
+			if (!m_passable[(unsigned char)target])
+			{
+				CheckSurfaced(grid, x, y, z);
+				return live;
+			}
+			
+			if (material ? Random::Float() < m_materials[material - 1].killProbability : m_killBubble->Kill(x, y, z))
+			{
+				grid(x, y, z) = m_staticVoid;
+				Unsettle();
+			}
+			else 
+			{
+				grid(x, y, z) = target;
+				grid.Neighbour(x, y, z, offset) = m_void;
+				m_killBubble->Move(x, y, z, x + offset.x, y + offset.y, z + offset.z);
+				observer.Changed(x + offset.x, y + offset.y, z + offset.z);
+				if (!m_air[(unsigned char)target] || (!m_unsettled && Undermines(grid, x, y, z)))
+					Unsettle();
+				
+				// A void leaving the top of the grid is not tested further up
+				if (y + offset.y < grid.GetHeight())
+					CheckSurfaced(grid, x + offset.x, y + offset.y, z + offset.z);
+				else
+					Unsettle();
+			}
+			observer.Changed(x, y, z);
+			return true;
+		}
+		
+		// Offset of a void's move among the cells of value in its neighbourhood. A single
+		// draw usually finds one; on a miss the offset is drawn from the matching cells
+		// only, which together give exactly the restricted distribution without redrawing.
+		template<typename Grid>
+		CellOffset SelectOffset(Grid &grid, int x, int y, int z, char value, SelectionSet<CellOffset> &neighbourhood)
+		{
+			CellOffset offset = neighbourhood.RouletteSelect();
+			if (grid.Neighbour(x, y, z, offset) == value)
+				return offset;
+			
+			double total = 0;
+			for (int i = 0; i < neighbourhood.GetSetSize(); i++)
+			{
+				if (grid.Neighbour(x, y, z, neighbourhood.GetValue(i)) == value)
+					total += neighbourhood.GetProbability(i);
+			}
+			
+			double r = Random::Float() * total;
+			for (int i = 0; i < neighbourhood.GetSetSize(); i++)
+			{
+				if (grid.Neighbour(x, y, z, neighbourhood.GetValue(i)) == value)
+				{
+					r -= neighbourhood.GetProbability(i);
+					if (r < 0)
+						return neighbourhood.GetValue(i);
+				}
+			}
+			return offset;
+		}
+		
+		// Note that the grid is not settled - once one update has, the others skip the
+		// tests below
+		void Unsettle()
+		{
+			if (!m_unsettled)
+				__sync_fetch_and_or(&m_unsettled, 1);
+		}
+		
+		// Unsettle the grid unless the void at (x, y, z) has reached the surface or cannot
+		// move (see IsSettled())
+		template<typename Cells>
+		void CheckSurfaced(Cells &cells, int x, int y, int z)
+		{
+			if (m_unsettled)
+				return;
+			
+			for (int i = 0; i < m_neighbourhood.GetSetSize(); i++)
+			{
+				const CellOffset &offset = m_neighbourhood.GetValue(i);
+				unsigned char target = cells(x + offset.x, y + offset.y, z + offset.z);
+				if (m_passable[target] && !m_air[target])
+				{
+					Unsettle();
+					return;
+				}
+			}
+			if (Undermines(cells, x, y, z))
+				Unsettle();
+		}
+		
+		// True if a collapsing cell would fall were cell (x, y, z) a gap - the cell above
+		// it, or a cell next to it or to the cell above with a gap below
+		template<typename Cells>
+		bool Undermines(Cells &cells, int x, int y, int z) const
+		{
+			static const int dx[4] = { 0, 0, 1, -1 };
+			static const int dz[4] = { 1, -1, 0, 0 };
+			
+			if (m_rule[(unsigned char)cells(x, y + 1, z)] == COLLAPSE)
+				return true;
+			for (int i = 0; i < 4; i++)
+			{
+				int nx = x + dx[i], nz = z + dz[i];
+				if (m_rule[(unsigned char)cells(nx, y, nz)] == COLLAPSE && m_gap[(unsigned char)cells(nx, y - 1, nz)])
+					return true;
+				if (m_rule[(unsigned char)cells(nx, y + 1, nz)] == COLLAPSE && m_gap[(unsigned char)cells(nx, y, nz)])
+					return true;
+			}
+			return false;
+		}
+		
+		// Leave a void and advance onto fuel, trying +z, -z, +x then -x. Fuel is looked
+		// for in cells (the grid itself, or the cells before a synchronous update).
+		template<typename Grid, typename Cells, typename Observer>
+		void UpdateDrill(Grid &grid, Cells &cells, int x, int y, int z, Observer &observer)
+		{
+			static const int dx[4] = { 0, 0, 1, -1 };
+			static const int dz[4] = { 1, -1, 0, 0 };
+			
+			grid(x, y, z) = m_void;
+			observer.Changed(x, y, z);
+			for (int i = 0; i < 4; i++)
+			{
+				if (m_fuel[(unsigned char)cells(x + dx[i], y, z + dz[i])])
+				{
+					grid(x + dx[i], y, z + dz[i]) = m_drill;
+					observer.Changed(x + dx[i], y, z + dz[i]);
+					return;
+				}
+			}
+		}
+		
+		// True if a neighbour of cell (x, y, z) or of the cell below it is a gap in cells
+		template<typename Cells>
+		bool NextToGap(Cells &cells, int x, int y, int z) const
+		{
+			return m_gap[(unsigned char)cells(x - 1, y - 1, z)]
+				|| m_gap[(unsigned char)cells(x + 1, y - 1, z)]
+				|| m_gap[(unsigned char)cells(x, y - 1, z - 1)]
+				|| m_gap[(unsigned char)cells(x, y - 1, z + 1)]
+				|| m_gap[(unsigned char)cells(x - 1, y, z)]
+				|| m_gap[(unsigned char)cells(x + 1, y, z)]
+				|| m_gap[(unsigned char)cells(x, y, z - 1)]
+				|| m_gap[(unsigned char)cells(x, y, z + 1)];
+		}
+		
+		// Fall into a gap below if a neighbour or a neighbour of the gap is also a gap
+		template<typename Grid, typename Observer>
+		bool UpdateCollapse(Grid &grid, int x, int y, int z, Observer &observer)
+		{
+			if (!m_gap[(unsigned char)grid(x, y - 1, z)] || !NextToGap(grid, x, y, z))
+				return false;
+			
+			grid.ShiftDown(x, y, z);
+			m_killBubble->ShiftDown(x, y, z);
+			observer.Shifted(x, y, z);
+			Unsettle();
+			return true;
+		}
+		
+		// Synchronous PROPOSE phase - claim the target of a void or kill it, or advance a
+		// drill
+		template<typename Grid>
+		bool Propose(Grid &grid, int x, int y, int z, unsigned int iteration)
+		{
+			Before<Grid> before(grid, m_void);
+			NoObserver observer;
+			switch (m_rule[(unsigned char)grid.Previous(x, y, z)])
+			{
+				case MOVE:
+					break;
+				case DRILL:
+					UpdateDrill(grid, before, x, y, z, observer);
+					Unsettle();
+					return true;
+				default:
+					return false;
+			}
+			
+			bool live = y < grid.GetHeight() - 1;
+			Random::SetStream(iteration, m_originX + x, m_originY + y, m_originZ + z);
+			int choice = m_neighbourhood.RouletteSelectIndex();
+			const CellOffset &offset = m_neighbourhood.GetValue(choice);
+			char target = before(x + offset.x, y + offset.y, z + offset.z);
+			if (!m_passable[(unsigned char)target] || target == m_void)
+			{
+				CheckSurfaced(before, x, y, z);
+				return live;
+			}
+			
+			if (m_killBubble->Kill(x, y, z))
+			{
+				grid(x, y, z) = m_staticVoid;
+				Unsettle();
+			}
+			else
+			{
+				// The claim may lose, so both places are checked
+				grid.Previous(x, y, z) = CLAIM | choice;
+				if (!m_air[(unsigned char)target])
+					Unsettle();
+				CheckSurfaced(before, x, y, z);
+				if (y + offset.y < grid.GetHeight())
+					CheckSurfaced(before, x + offset.x, y + offset.y, z + offset.z);
+				else
+					Unsettle();
+			}
+			return true;
+		}
+		
+		// Synchronous RESOLVE phase - move a claiming void onto its target unless another
+		// claim on the target has a higher priority (equal priorities go to the lower
+		// neighbourhood index)
+		template<typename Grid>
+		bool Resolve(Grid &grid, int x, int y, int z, unsigned int iteration)
+		{
+			unsigned char claim = grid.Previous(x, y, z);
+			if (!(claim & CLAIM))
+				return false;
+			
+			int choice = claim & ~CLAIM;
+			const CellOffset &offset = m_neighbourhood.GetValue(choice);
+			int tx = x + offset.x, ty = y + offset.y, tz = z + offset.z;
+			bool contested = false;
+			unsigned int priority = 0;
+			for (int i = 0; i < m_neighbourhood.GetSetSize(); i++)
+			{
+				const CellOffset &other = m_neighbourhood.GetValue(i);
+				int sx = tx - other.x, sy = ty - other.y, sz = tz - other.z;
+				if (i != choice && (unsigned char)grid.Previous(sx, sy, sz) == (CLAIM | i))
+				{
+					if (!contested)
+						priority = Priority(grid, x, y, z, iteration);
+					contested = true;
+					unsigned int competitor = Priority(grid, sx, sy, sz, iteration);
+					if (competitor > priority || (competitor == priority && i < choice))
+						return true;
+				}
+			}
+			
+			grid(x, y, z) = grid.Previous(tx, ty, tz);
+			grid(tx, ty, tz) = m_void;
+			m_killBubble->Move(x, y, z, tx, ty, tz);
+			return true;
+		}
+		
+		// Synchronous SETTLE phase - collapse onto a gap in the column as it is now, next
+		// to gaps as they were
+		template<typename Grid>
+		bool Settle(Grid &grid, int x, int y, int z)
+		{
+			Before<Grid> before(grid, m_void);
+			if (m_rule[(unsigned char)grid(x, y, z)] != COLLAPSE || !m_gap[(unsigned char)grid(x, y - 1, z)] || !NextToGap(before, x, y, z))
+				return false;
+			
+			grid.ShiftDown(x, y, z);
+			m_killBubble->ShiftDown(x, y, z);
+			Unsettle();
+			return true;
+		}
+		
+		// Priority of a claim by the void at (x, y, z) - wrapped coordinates are brought
+		// inside the grid first, so every claimant of a target computes the same value
+		template<typename Grid>
+		unsigned int Priority(Grid &grid, int x, int y, int z, unsigned int iteration) const
+		{
+			int width = grid.GetWidth();
+			int depth = grid.GetDepth();
+			return Random::Hash(iteration, m_originX + (x % width + width) % width, m_originY + y, m_originZ + (z % depth + depth) % depth);
+		}
+
+		// Neighbourhood of voids rising into a value with its own (see SetNeighbourhood())
+		struct Material
+		{
+			SelectionSet<CellOffset> neighbourhood;
+			float killProbability;
+		};
+		typedef struct Material Material;
+
+		static void SetValues(bool *table, const std::string &values);
+
+		unsigned char m_rule[256];
+		bool m_passable[256];
+		bool m_fuel[256];
+		bool m_gap[256];
+		bool m_air[256];
+		char m_void;
+		char m_staticVoid;
+		char m_drill;
+		int m_originX;
+		int m_originY;
+		int m_originZ;
+		SelectionSet<CellOffset> m_neighbourhood;
+		std::vector<Material> m_materials;
+		unsigned char m_material[256];	// 1 + index into m_materials, 0 for none
+		KillBubble *m_killBubble;
+		VoidJumps *m_jumps;
+		bool m_settling;
+		char m_unsettled;
+};
+
+#endif
@@ -0,0 +1,307 @@
+
+#include "Checkpoint.h"
+#include "Random.h"
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static const char MAGIC[6] = { 'C', 'A', 'C', 'K', 'P', 'T' };
+static const int BUFFER_SIZE = 1 << 16;
+
+// Buffered writes straight to a file descriptor (no stdio, safe in a forked child)
+struct OutputStream
+{
+	int fd;
+	int length;
+	bool failed;
+	unsigned char buffer[BUFFER_SIZE];
+
+	void Flush()
+	{
+		unsigned char *data = buffer;
+		while (length > 0 && !failed)
+		{
+			ssize_t written = write(fd, data, length);
+			if (written <= 0)
+				failed = true;
+			else
+			{
+				data += written;
+				length -= written;
+			}
+		}
+		length = 0;
+	}
+
+	void Put(unsigned char byte)
+	{
+		if (length == BUFFER_SIZE)
+			Flush();
+		buffer[length++] = byte;
+	}
+
+	void Put(const void *data, int size)
+	{
+		for (int i = 0; i < size; i++)
+			Put(((const unsigned char*)data)[i]);
+	}
+
+	void PutRun(char value, uint64_t count)
+	{
+		Put(value);
+		while (count >= 0x80)
+		{
+			Put((unsigned char)(count | 0x80));
+			count >>= 7;
+		}
+		Put((unsigned char)count);
+	}
+};
+typedef struct OutputStream OutputStream;
+
+struct InputStream
+{
+	int fd;
+	int length;
+	int position;
+	bool failed;
+	unsigned char buffer[BUFFER_SIZE];
+
+	unsigned char Get()
+	{
+		if (position == length)
+		{
+			ssize_t count = failed ? 0 : read(fd, buffer, BUFFER_SIZE);
+			if (count <= 0)
+			{
+				failed = true;
+				return 0;
+			}
+			length = count;
+			position = 0;
+		}
+		return buffer[position++];
+	}
+
+	void Get(void *data, int size)
+	{
+		for (int i = 0; i < size; i++)
+			((unsigned char*)data)[i] = Get();
+	}
+
+	bool GetRun(char &value, uint64_t &count)
+	{
+		value = Get();
+		count = 0;
+		for (int shift = 0; shift < 64 && !failed; shift += 7)
+		{
+			unsigned char byte = Get();
+			count |= (uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return !failed;
+		}
+		return false;
+	}
+
+	bool AtEnd()
+	{
+		return position == length && read(fd, buffer, 1) == 0;
+	}
+};
+typedef struct InputStream InputStream;
+
+Checkpoint::Checkpoint()
+{
+	m_pid = 0;
+}
+
+Checkpoint::~Checkpoint()
+{
+	Wait();
+}
+
+bool Checkpoint::Save(CellGrid3D &grid, unsigned int iteration, const std::string &filename, bool background)
+{
+	Wait();
+	m_filename = filename;
+
+	// A forked child shares a memory-mapped grid instead of getting a copy, so it
+	// would see the cells change while it writes them
+	if (background && !grid.IsMapped())
+	{
+		m_pid = fork();
+		if (m_pid == 0)
+			_exit(Write(grid, iteration, filename) ? 0 : 1);
+		if (m_pid > 0)
+			return true;
+
+		// Fork failed - save in this process instead
+		m_pid = 0;
+	}
+
+	if (!Write(grid, iteration, filename))
+	{
+		std::cerr << "Could not save checkpoint file '" + filename + "'\n";
+		return false;
+	}
+	return true;
+}
+
+bool Checkpoint::Wait()
+{
+	if (m_pid <= 0)
+		return true;
+
+	int status;
+	bool success = waitpid(m_pid, &status, 0) == m_pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	m_pid = 0;
+
+	if (!success)
+		std::cerr << "Could not save checkpoint file '" + m_filename + "'\n";
+	return success;
+}
+
+bool Checkpoint::Write(CellGrid3D &grid, unsigned int iteration, const std::string &filename)
+{
+	std::string tempFile = filename + ".tmp";
+	OutputStream *out = new OutputStream;
+	out->fd = open(tempFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	out->length = 0;
+	out->failed = out->fd < 0;
+
+	// Header
+	unsigned char version = VERSION;
+	unsigned char halo = grid.GetHalo();
+	unsigned char layout = grid.GetLayout();
+	int32_t size[3] = { grid.GetWidth(), grid.GetHeight(), grid.GetDepth() };
+	uint32_t iterationCount = iteration;
+	int64_t seed = Random::GetSeed();
+	out->Put(MAGIC, sizeof(MAGIC));
+	out->Put(&version, 1);
+	out->Put(&halo, 1);
+	out->Put(&layout, 1);
+	out->Put(size, sizeof(size));
+	for (int i = 0; i < 6; i++)
+	{
+		out->Put((unsigned char)grid.GetBoundMode((CellGrid3D::Border)i));
+		out->Put(grid.GetBorderValue((CellGrid3D::Border)i));
+	}
+	out->Put(&iterationCount, sizeof(iterationCount));
+	out->Put(&seed, sizeof(seed));
+
+	// Cell data
+	const char *cells = grid.GetStorage();
+	long count = grid.GetStorageSize();
+	long start = 0;
+	for (long i = 1; i <= count && !out->failed; i++)
+	{
+		if (i == count || cells[i] != cells[start])
+		{
+			out->PutRun(cells[start], i - start);
+			start = i;
+		}
+	}
+	out->Flush();
+
+	bool success = !out->failed && fsync(out->fd) == 0;
+	if (out->fd >= 0 && close(out->fd) != 0)
+		success = false;
+	delete out;
+
+	if (success)
+		success = rename(tempFile.c_str(), filename.c_str()) == 0;
+	else
+		unlink(tempFile.c_str());
+	return success;
+}
+
+bool Checkpoint::Load(CellGrid3D &grid, unsigned int &iteration, const std::string &filename)
+{
+	InputStream *in = new InputStream;
+	in->fd = open(filename.c_str(), O_RDONLY);
+	in->length = 0;
+	in->position = 0;
+	in->failed = false;
+
+	if (in->fd < 0)
+	{
+		std::cerr << "Could not load checkpoint file '" + filename + "'\n";
+		delete in;
+		return false;
+	}
+
+	// Header
+	char magic[sizeof(MAGIC)];
+	unsigned char version, halo;
+	unsigned char layout = CellGrid3D::ROWS;
+	int32_t size[3];
+	unsigned char modes[6];
+	char borders[6];
+	uint32_t iterationCount;
+	int64_t seed;
+	in->Get(magic, sizeof(magic));
+	in->Get(&version, 1);
+	in->Get(&halo, 1);
+	if (version >= 2)
+		in->Get(&layout, 1);
+	in->Get(size, sizeof(size));
+	for (int i = 0; i < 6; i++)
+	{
+		modes[i] = in->Get();
+		borders[i] = in->Get();
+	}
+	in->Get(&iterationCount, sizeof(iterationCount));
+	in->Get(&seed, sizeof(seed));
+
+	bool valid = !in->failed && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 && version >= 1 && version <= VERSION;
+	valid = valid && layout <= CellGrid3D::BRICKS;
+	for (int i = 0; i < 3; i++)
+		valid = valid && size[i] > 0;
+	for (int i = 0; i < 6; i++)
+		valid = valid && modes[i] <= CellGrid3D::IGNORE;
+
+	// Cell data
+	if (valid)
+	{
+		grid.SetLayout((CellGrid3D::Layout)layout);
+		grid.SetHalo(halo);
+		valid = grid.SetSize(size[0], size[1], size[2]);
+	}
+	if (valid)
+	{
+		char *cells = grid.GetStorage();
+		uint64_t remaining = grid.GetStorageSize();
+		while (valid && remaining > 0)
+		{
+			char value;
+			uint64_t count;
+			valid = in->GetRun(value, count) && count > 0 && count <= remaining;
+			if (valid)
+			{
+				memset(cells, value, count);
+				cells += count;
+				remaining -= count;
+			}
+		}
+		valid = valid && in->AtEnd();
+	}
+	close(in->fd);
+	delete in;
+
+	if (!valid)
+	{
+		std::cerr << "Invalid checkpoint file '" + filename + "'\n";
+		return false;
+	}
+
+	// Bound modes are set after the cells so that border values in the halo are kept
+	for (int i = 0; i < 6; i++)
+		grid.SetBoundMode((CellGrid3D::BoundMode)modes[i], (CellGrid3D::Border)i, borders[i]);
+	iteration = iterationCount;
+	Random::SetSeed(seed);
+	return true;
+}
@@ -0,0 +1,62 @@
+
+/*
+ * @file	Checkpoint.h/.cpp
+ * @brief	Saves and restores the state of a 3D cellular automata simulation.
+ * @details	A checkpoint file holds a header followed by the cell data:
+ *				- magic "CACKPT" and format version
+ *				- grid dimensions, halo size and layout (version 2 on, version 1 files
+ *					are always ROWS)
+ *				- bound mode and border value of each border
+ *				- number of iterations completed and random seed (the random numbers
+ *					of an iteration only depend on the seed, see Random.h)
+ *				- cell data, run-length encoded
+ *			The cell data is the grid's whole storage including the halo, so a resumed
+ *			simulation continues exactly as the original would have. Runs are a cell
+ *			value followed by the run length (7 bits per byte, low bits first).
+ *			Values are stored in the byte order of the machine that saved them.
+ *			Cells are encoded straight from the grid through a small buffer, without
+ *			copying the grid. With background set, Save() forks and the child process
+ *			writes the file while the parent continues the simulation - the child sees
+ *			the grid as it was when Save() was called (memory is copy-on-write), so the
+ *			simulation only waits for the fork (grids in a memory-mapped file are always
+ *			saved in the calling process, see CellGrid3D::SetStorageFile). The file is
+ *			written under a temporary name and renamed when complete, so the last
+ *			checkpoint survives a crash during a save.
+ * @author	Matt Drage
+ * @date	04/03/2013
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <sys/types.h>
+#include "CellGrid3D.h"
+
+class Checkpoint
+{
+	public:
+		static const int VERSION = 2;
+
+		// Constructors & Destructors
+		Checkpoint();
+		virtual ~Checkpoint();
+
+		// Save grid state after 'iteration' iterations, waits for the previous
+		// background save first
+		bool Save(CellGrid3D &grid, unsigned int iteration, const std::string &filename, bool background = false);
+
+		// Wait for a background save to complete, returns false if it failed
+		bool Wait();
+
+		// Restore grid size, layout, bound modes, cells and random seed
+		static bool Load(CellGrid3D &grid, unsigned int &iteration, const std::string &filename);
+
+	private:
+		static bool Write(CellGrid3D &grid, unsigned int iteration, const std::string &filename);
+
+		pid_t m_pid;
+		std::string m_filename;
+};
+
+#endif
@@ -0,0 +1,438 @@
+
+#include "HaloExchange.h"
+#include "MathUtils.h"
+#include <cstring>
+#include <cstdlib>
+#include <cassert>
+
+const int HALO_TAG_UP = 1;
+const int HALO_TAG_DOWN = 2;
+
+void HaloExchange2D::Merge(char *current, const char *reference, const char *returned, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (returned[i] != reference[i] && current[i] == reference[i])
+			current[i] = returned[i];
+	}
+}
+
+void HaloExchange2D::FindLost(const char *current, const char *reference, const char *returned, int count, const std::string &moved, std::vector<int> &lost)
+{
+	lost.clear();
+	for (int i = 0; i < count; i++)
+	{
+		if (returned[i] != reference[i] && current[i] != reference[i] && moved.find(returned[i]) != std::string::npos)
+			lost.push_back(i);
+	}
+}
+
+HaloExchange2D::HaloExchange2D()
+{
+	Init(MPI_COMM_WORLD, MPI_PROC_NULL, MPI_PROC_NULL);
+}
+
+HaloExchange2D::HaloExchange2D(MPI_Comm comm, int below, int above)
+{
+	Init(comm, below, above);
+}
+
+void HaloExchange2D::Init(MPI_Comm comm, int below, int above)
+{
+	m_comm = comm;
+	m_below.rank = below;
+	m_below.pending = false;
+	m_above.rank = above;
+	m_above.pending = false;
+}
+
+void HaloExchange2D::SetMoved(const std::string &values)
+{
+	m_moved = values;
+}
+
+void HaloExchange2D::Start(CellGrid2D &grid)
+{
+	assert(grid.GetHalo() >= 1);
+
+	int width = grid.GetWidth();
+	int top = grid.GetHeight() - 1;
+	Link *links[2] = { &m_below, &m_above };
+	int ownRow[2] = { 0, top };
+	int ghostRow[2] = { -1, top + 1 };
+	int sendTag[2] = { HALO_TAG_DOWN, HALO_TAG_UP };
+	int recvTag[2] = { HALO_TAG_UP, HALO_TAG_DOWN };
+
+	for (int i = 0; i < 2; i++)
+	{
+		Link &link = *links[i];
+		link.reference.assign(grid.GetRow(ownRow[i]), grid.GetRow(ownRow[i]) + width);
+		link.sendBuffer.resize(2 * width);
+		link.recvBuffer.resize(2 * width);
+		link.scratch.resize(width);
+		link.sendRequest = MPI_REQUEST_NULL;
+		link.recvRequest = MPI_REQUEST_NULL;
+		link.pending = false;
+
+		if (link.rank == MPI_PROC_NULL)
+			continue;
+
+		MPI_Sendrecv(grid.GetRow(ownRow[i]), width, MPI_CHAR, link.rank, sendTag[i],
+					 grid.GetRow(ghostRow[i]), width, MPI_CHAR, link.rank, recvTag[i],
+					 m_comm, MPI_STATUS_IGNORE);
+		link.ghost.assign(grid.GetRow(ghostRow[i]), grid.GetRow(ghostRow[i]) + width);
+	}
+}
+
+void HaloExchange2D::ReceiveAbove(CellGrid2D &grid)
+{
+	int top = grid.GetHeight() - 1;
+	Receive(grid, m_above, top, top + 1);
+}
+
+void HaloExchange2D::ReceiveBelow(CellGrid2D &grid)
+{
+	Receive(grid, m_below, 0, -1);
+}
+
+void HaloExchange2D::Receive(CellGrid2D &grid, Link &link, int ownRow, int ghostRow)
+{
+	if (link.rank == MPI_PROC_NULL || !link.pending)
+		return;
+
+	int width = grid.GetWidth();
+	MPI_Wait(&link.recvRequest, MPI_STATUS_IGNORE);
+	link.pending = false;
+
+	// Message holds the neighbour's boundary row followed by its writes to our boundary row
+	char *fresh = &link.recvBuffer[0];
+	char *returned = &link.recvBuffer[width];
+
+	// Apply neighbour's writes to our boundary row, voids that lost go to our nearest
+	// cell holding the value they replaced
+	char *own = grid.GetRow(ownRow);
+	FindLost(own, &link.reference[0], returned, width, m_moved, link.lost);
+	Merge(own, &link.reference[0], returned, width);
+	for (unsigned int i = 0; i < link.lost.size(); i++)
+		Relocate(grid, link.lost[i], ownRow, returned[link.lost[i]], link.reference[link.lost[i]]);
+	
+	// The neighbour only knows the row we sent, merged with its own writes
+	char *scratch = &link.scratch[0];
+	memcpy(scratch, &link.sendBuffer[0], width);
+	Merge(scratch, &link.reference[0], returned, width);
+	memcpy(&link.reference[0], scratch, width);
+
+	// The neighbour merges our ghost writes the same way - apply them to its fresh row
+	char *written = &link.sendBuffer[width];
+	Merge(fresh, &link.ghost[0], written, width);
+	memcpy(grid.GetRow(ghostRow), fresh, width);
+	memcpy(&link.ghost[0], fresh, width);
+}
+
+void HaloExchange2D::Relocate(CellGrid2D &grid, int x, int y, char value, char replaced)
+{
+	// Columns x, x - 1, x + 1, x - 2, ..., rows y, y - 1, y + 1, y - 2, ... in each. Only
+	// if no own cell holds the replaced value is the moved one dropped.
+	int width = grid.GetWidth();
+	int height = grid.GetHeight();
+	for (int i = 0; i < 2 * width; i++)
+	{
+		int cx = (i & 1) ? x - (i + 1) / 2 : x + i / 2;
+		if (cx < 0 || cx >= width)
+			continue;
+		
+		for (int j = 0; j < 2 * height; j++)
+		{
+			int cy = (j & 1) ? y - (j + 1) / 2 : y + j / 2;
+			if (cy >= 0 && cy < height && grid(cx, cy) == replaced)
+			{
+				grid(cx, cy) = value;
+				return;
+			}
+		}
+	}
+}
+
+void HaloExchange2D::Send(CellGrid2D &grid)
+{
+	int top = grid.GetHeight() - 1;
+	Send(grid, m_below, 0, -1, HALO_TAG_DOWN);
+	Send(grid, m_above, top, top + 1, HALO_TAG_UP);
+}
+
+void HaloExchange2D::Send(CellGrid2D &grid, Link &link, int ownRow, int ghostRow, int tag)
+{
+	if (link.rank == MPI_PROC_NULL)
+		return;
+
+	int width = grid.GetWidth();
+	int recvTag = (tag == HALO_TAG_UP) ? HALO_TAG_DOWN : HALO_TAG_UP;
+
+	// Previous send must complete before its buffer is reused
+	MPI_Wait(&link.sendRequest, MPI_STATUS_IGNORE);
+	memcpy(&link.sendBuffer[0], grid.GetRow(ownRow), width);
+	memcpy(&link.sendBuffer[width], grid.GetRow(ghostRow), width);
+
+	MPI_Irecv(&link.recvBuffer[0], 2 * width, MPI_CHAR, link.rank, recvTag, m_comm, &link.recvRequest);
+	MPI_Isend(&link.sendBuffer[0], 2 * width, MPI_CHAR, link.rank, tag, m_comm, &link.sendRequest);
+	link.pending = true;
+}
+
+void HaloExchange2D::Finish(CellGrid2D &grid)
+{
+	ReceiveAbove(grid);
+	ReceiveBelow(grid);
+	MPI_Wait(&m_below.sendRequest, MPI_STATUS_IGNORE);
+	MPI_Wait(&m_above.sendRequest, MPI_STATUS_IGNORE);
+}
+
+HaloExchange3D::HaloExchange3D()
+{
+	m_comm = MPI_COMM_NULL;
+	for (int i = 0; i < NUM_LINKS; i++)
+	{
+		m_links[i].rank = MPI_PROC_NULL;
+		m_links[i].pending = false;
+	}
+}
+
+HaloExchange3D::HaloExchange3D(MPI_Comm cartComm)
+{
+	Init(cartComm);
+}
+
+int HaloExchange3D::LinkIndex(int dx, int dz)
+{
+	return (dx + 1) * 3 + (dz + 1);
+}
+
+void HaloExchange3D::Init(MPI_Comm cartComm)
+{
+	m_comm = cartComm;
+	
+	int dims[2], periods[2], coords[2];
+	MPI_Cart_get(cartComm, 2, dims, periods, coords);
+	
+	for (int dx = -1; dx <= 1; dx++)
+	{
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			Link &link = m_links[LinkIndex(dx, dz)];
+			link.rank = MPI_PROC_NULL;
+			link.pending = false;
+			if (dx == 0 && dz == 0)
+				continue;
+			
+			// Axes with a single processor are not split (wrapping is left to the grid)
+			int c[2] = { coords[0] + dx, coords[1] + dz };
+			bool valid = true;
+			for (int i = 0; i < 2; i++)
+			{
+				if (c[i] == coords[i])
+					continue;
+				if (dims[i] == 1)
+					valid = false;
+				else if (c[i] < 0 || c[i] >= dims[i])
+				{
+					if (periods[i])
+						c[i] = (c[i] + dims[i]) % dims[i];
+					else
+						valid = false;
+				}
+			}
+			
+			if (valid)
+				MPI_Cart_rank(cartComm, c, &link.rank);
+		}
+	}
+}
+
+bool HaloExchange3D::HasNeighbour(int dx, int dz) const
+{
+	return m_links[LinkIndex(dx, dz)].rank != MPI_PROC_NULL;
+}
+
+void HaloExchange3D::Pack(CellGrid3D &grid, const Block &block, char *buffer)
+{
+	grid.ExtractCells(buffer, block.x1 - block.x0, grid.GetHeight(), block.z1 - block.z0, block.x0, 0, block.z0);
+}
+
+void HaloExchange3D::Unpack(CellGrid3D &grid, const Block &block, const char *buffer)
+{
+	grid.CopyCells(buffer, block.x1 - block.x0, grid.GetHeight(), block.z1 - block.z0, block.x0, 0, block.z0);
+}
+
+void HaloExchange3D::Start(CellGrid3D &grid, int reach)
+{
+	assert(grid.GetHalo() >= reach);
+	
+	int width = grid.GetWidth();
+	int depth = grid.GetDepth();
+	for (int dx = -1; dx <= 1; dx++)
+	{
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			Link &link = m_links[LinkIndex(dx, dz)];
+			link.pending = false;
+			link.sendRequest = MPI_REQUEST_NULL;
+			link.recvRequest = MPI_REQUEST_NULL;
+			if (link.rank == MPI_PROC_NULL)
+				continue;
+			
+			// Blocks are 'reach' columns wide across a boundary, the whole side along it
+			link.own.x0 = (dx > 0) ? width - reach : 0;
+			link.own.x1 = (dx < 0) ? reach : width;
+			link.own.z0 = (dz > 0) ? depth - reach : 0;
+			link.own.z1 = (dz < 0) ? reach : depth;
+			link.ghost.x0 = (dx > 0) ? width : (dx < 0) ? -reach : 0;
+			link.ghost.x1 = (dx > 0) ? width + reach : (dx < 0) ? 0 : width;
+			link.ghost.z0 = (dz > 0) ? depth : (dz < 0) ? -reach : 0;
+			link.ghost.z1 = (dz > 0) ? depth + reach : (dz < 0) ? 0 : depth;
+			link.size = (link.own.x1 - link.own.x0) * (link.own.z1 - link.own.z0) * grid.GetHeight();
+			
+			link.reference.resize(link.size);
+			link.ghostCells.resize(link.size);
+			link.sendBuffer.resize(2 * link.size);
+			link.recvBuffer.resize(2 * link.size);
+			link.scratch.resize(link.size);
+		}
+	}
+	
+	// Tags identify the direction a message travels, so a neighbour on two sides (two
+	// processors along a wrapped axis) can tell the messages apart
+	std::vector<MPI_Request> requests;
+	for (int i = 0; i < NUM_LINKS; i++)
+	{
+		Link &link = m_links[i];
+		if (link.rank == MPI_PROC_NULL)
+			continue;
+		
+		Pack(grid, link.own, &link.reference[0]);
+		requests.push_back(MPI_REQUEST_NULL);
+		MPI_Irecv(&link.ghostCells[0], link.size, MPI_CHAR, link.rank, NUM_LINKS - 1 - i, m_comm, &requests.back());
+		requests.push_back(MPI_REQUEST_NULL);
+		MPI_Isend(&link.reference[0], link.size, MPI_CHAR, link.rank, i, m_comm, &requests.back());
+	}
+	if (!requests.empty())
+		MPI_Waitall(requests.size(), &requests[0], MPI_STATUSES_IGNORE);
+	
+	for (int i = 0; i < NUM_LINKS; i++)
+	{
+		if (m_links[i].rank != MPI_PROC_NULL)
+			Unpack(grid, m_links[i].ghost, &m_links[i].ghostCells[0]);
+	}
+}
+
+void HaloExchange3D::Receive(CellGrid3D &grid)
+{
+	for (int i = 0; i < NUM_LINKS; i++)
+		Receive(grid, m_links[i]);
+}
+
+void HaloExchange3D::SetMoved(const std::string &values)
+{
+	m_moved = values;
+}
+
+void HaloExchange3D::Receive(CellGrid3D &grid, Link &link)
+{
+	if (link.rank == MPI_PROC_NULL || !link.pending)
+		return;
+	
+	MPI_Wait(&link.recvRequest, MPI_STATUS_IGNORE);
+	link.pending = false;
+	
+	// Message holds the neighbour's boundary block followed by its writes to our block
+	char *fresh = &link.recvBuffer[0];
+	char *returned = &link.recvBuffer[link.size];
+	char *sent = &link.sendBuffer[0];
+	char *written = &link.sendBuffer[link.size];
+	char *scratch = &link.scratch[0];
+	
+	// Apply neighbour's writes to our block, voids that lost go to our nearest cell
+	// holding the value they replaced
+	Pack(grid, link.own, scratch);
+	HaloExchange2D::FindLost(scratch, &link.reference[0], returned, link.size, m_moved, link.lost);
+	HaloExchange2D::Merge(scratch, &link.reference[0], returned, link.size);
+	Unpack(grid, link.own, scratch);
+	
+	// Blocks are packed by row, then x, then z (see CellRegion3D::Pack)
+	int blockWidth = link.own.x1 - link.own.x0;
+	int blockDepth = link.own.z1 - link.own.z0;
+	for (unsigned int i = 0; i < link.lost.size(); i++)
+	{
+		int index = link.lost[i];
+		int x = link.own.x0 + (index / blockDepth) % blockWidth;
+		int y = index / (blockWidth * blockDepth);
+		int z = link.own.z0 + index % blockDepth;
+		Relocate(grid, x, y, z, returned[index], link.reference[index]);
+	}
+	
+	// The neighbour only knows the block we sent, merged with its own writes
+	memcpy(scratch, sent, link.size);
+	HaloExchange2D::Merge(scratch, &link.reference[0], returned, link.size);
+	memcpy(&link.reference[0], scratch, link.size);
+	
+	// The neighbour merges our ghost writes the same way - apply them to its fresh block
+	HaloExchange2D::Merge(fresh, &link.ghostCells[0], written, link.size);
+	Unpack(grid, link.ghost, fresh);
+	memcpy(&link.ghostCells[0], fresh, link.size);
+}
+
+void HaloExchange3D::Relocate(CellGrid3D &grid, int x, int y, int z, char value, char replaced)
+{
+	int width = grid.GetWidth();
+	int height = grid.GetHeight();
+	int depth = grid.GetDepth();
+	int rings = Max(width, depth);
+	for (int d = 0; d < rings; d++)
+	{
+		for (int cx = Max(x - d, 0); cx <= Min(x + d, width - 1); cx++)
+		{
+			for (int cz = Max(z - d, 0); cz <= Min(z + d, depth - 1); cz++)
+			{
+				if (abs(cx - x) != d && abs(cz - z) != d)
+					continue;
+				
+				for (int j = 0; j < 2 * height; j++)
+				{
+					int cy = (j & 1) ? y - (j + 1) / 2 : y + j / 2;
+					if (cy >= 0 && cy < height && grid(cx, cy, cz) == replaced)
+					{
+						grid(cx, cy, cz) = value;
+						return;
+					}
+				}
+			}
+		}
+	}
+}
+
+void HaloExchange3D::Send(CellGrid3D &grid)
+{
+	for (int i = 0; i < NUM_LINKS; i++)
+	{
+		Link &link = m_links[i];
+		if (link.rank == MPI_PROC_NULL)
+			continue;
+		
+		// Previous send must complete before its buffer is reused
+		MPI_Wait(&link.sendRequest, MPI_STATUS_IGNORE);
+		Pack(grid, link.own, &link.sendBuffer[0]);
+		Pack(grid, link.ghost, &link.sendBuffer[link.size]);
+		
+		MPI_Irecv(&link.recvBuffer[0], 2 * link.size, MPI_CHAR, link.rank, NUM_LINKS - 1 - i, m_comm, &link.recvRequest);
+		MPI_Isend(&link.sendBuffer[0], 2 * link.size, MPI_CHAR, link.rank, i, m_comm, &link.sendRequest);
+		link.pending = true;
+	}
+}
+
+void HaloExchange3D::Finish(CellGrid3D &grid)
+{
+	Receive(grid);
+	for (int i = 0; i < NUM_LINKS; i++)
+	{
+		if (m_links[i].rank != MPI_PROC_NULL)
+			MPI_Wait(&m_links[i].sendRequest, MPI_STATUS_IGNORE);
+	}
+}
@@ -0,0 +1,183 @@
+
+/*
+ * @file	HaloExchange.h/.cpp
+ * @brief	Exchanges ghost cells between neighbouring MPI processors.
+ * @details	Each processor owns a block of the cell grid and keeps copies of its neighbours'
+ *			boundary cells in the ghost halo of its CellGrid (see CellGrid2D::SetHalo).
+ *			Updates may read and write the ghost cells. Writes are returned to the owner
+ *			with the next exchange and merged into its boundary cells:
+ *				- a ghost cell changed by the neighbour replaces the owner's cell only if the
+ *					owner did not change that cell itself in the meantime (owner wins).
+ *				- both sides apply the same rule to the same data, so the owner's boundary
+ *					and the neighbour's ghost copy always agree after a merge.
+ *				- a void written by a move that loses is not dropped - the neighbour has
+ *					already put the value it replaced in the void's old cell, so the void
+ *					takes the owner's nearest cell still holding that value instead (see
+ *					SetMoved). The number of cells of each value is kept.
+ *			All messages are non-blocking (MPI_Isend/Irecv). Ghosts are received as late as
+ *			possible so that cells not touching the halo can be updated while messages are
+ *			in flight.
+ *			HaloExchange2D: grid split into horizontal bands of rows, one ghost row above
+ *			and below. Call Start() once, then every iteration:
+ *				ReceiveAbove(), update rows not touching the bottom boundary,
+ *				ReceiveBelow(), update the remaining rows, Send().
+ *			HaloExchange3D: x/z plane split over a 2D Cartesian communicator, ghost blocks of
+ *			'reach' columns on the four faces and four edges of each block. Call Start() once,
+ *			then every iteration:
+ *				update columns at least 2 * reach from a shared boundary (see HasNeighbour),
+ *				Receive(), update the remaining columns, Send().
+ *			The owned cells sent to the face and edge neighbours overlap, so a cell written
+ *			by two neighbours keeps the first write merged. The neighbour that lost sees
+ *			the owner's value with the next exchange (a void that lost is relocated as
+ *			above).
+ *			Call Finish() after the last iteration to merge the final ghost writes.
+ * @author	Matt Drage
+ * @date	18/02/2013
+ */
+
+#ifndef HALOEXCHANGE_H
+#define HALOEXCHANGE_H
+
+#include <mpi.h>
+#include <vector>
+#include <string>
+#include "CellGrid2D.h"
+#include "CellGrid3D.h"
+
+class HaloExchange2D
+{
+	public:
+		// Constructors
+		HaloExchange2D();
+		HaloExchange2D(MPI_Comm comm, int below, int above);
+
+		// Set neighbouring processors (MPI_PROC_NULL if there is none)
+		void Init(MPI_Comm comm, int below, int above);
+
+		// Exchange boundary rows before the first iteration (blocking)
+		void Start(CellGrid2D &grid);
+
+		// Wait for the neighbour's message and merge it (no effect if none is pending)
+		void ReceiveAbove(CellGrid2D &grid);
+		void ReceiveBelow(CellGrid2D &grid);
+
+		// Values written by moves (voids, see CellRules::GetVoids) that are relocated
+		// rather than dropped when they lose to the owner's change (none by default)
+		void SetMoved(const std::string &values);
+
+		// Send boundary rows and ghost writes at the end of an iteration
+		void Send(CellGrid2D &grid);
+
+		// Merge ghost writes from the last iteration and wait for outstanding sends
+		void Finish(CellGrid2D &grid);
+
+		// Apply cells changed by a neighbour (reference -> returned) that are unchanged
+		// in current
+		static void Merge(char *current, const char *reference, const char *returned, int count);
+
+		// Indices of cells changed by a neighbour to one of the moved values that Merge()
+		// will not apply, as current changed them too
+		static void FindLost(const char *current, const char *reference, const char *returned, int count, const std::string &moved, std::vector<int> &lost);
+
+	private:
+		struct Link
+		{
+			int rank;
+			bool pending;
+			std::vector<char> reference;	// Own boundary row as the neighbour has it
+			std::vector<char> ghost;		// Ghost row as received, before local writes
+			std::vector<char> sendBuffer;	// Own boundary row + written ghost row
+			std::vector<char> recvBuffer;
+			std::vector<char> scratch;
+			std::vector<int> lost;
+			MPI_Request sendRequest;
+			MPI_Request recvRequest;
+		};
+		typedef struct Link Link;
+
+		void Receive(CellGrid2D &grid, Link &link, int ownRow, int ghostRow);
+		void Send(CellGrid2D &grid, Link &link, int ownRow, int ghostRow, int tag);
+
+		// Write value to the own cell nearest (x, y) holding replaced - nearest column
+		// first, then nearest row in it
+		static void Relocate(CellGrid2D &grid, int x, int y, char value, char replaced);
+
+		MPI_Comm m_comm;
+		std::string m_moved;
+		Link m_below;
+		Link m_above;
+};
+
+class HaloExchange3D
+{
+	public:
+		// Constructors
+		HaloExchange3D();
+		HaloExchange3D(MPI_Comm cartComm);
+
+		// Find neighbours in a 2D Cartesian communicator (dimension 0 = x, 1 = z)
+		void Init(MPI_Comm cartComm);
+
+		// Neighbour in direction dx, dz (each -1, 0 or 1)
+		bool HasNeighbour(int dx, int dz) const;
+
+		// Exchange boundary blocks before the first iteration (blocking). The grid's halo
+		// must be at least reach deep.
+		void Start(CellGrid3D &grid, int reach);
+
+		// Wait for the neighbours' messages and merge them
+		void Receive(CellGrid3D &grid);
+
+		// See HaloExchange2D::SetMoved()
+		void SetMoved(const std::string &values);
+
+		// Send boundary blocks and ghost writes at the end of an iteration
+		void Send(CellGrid3D &grid);
+
+		// Merge ghost writes from the last iteration and wait for outstanding sends
+		void Finish(CellGrid3D &grid);
+
+	private:
+		// Cells [x0, x1) x [0, height) x [z0, z1)
+		struct Block
+		{
+			int x0, x1;
+			int z0, z1;
+		};
+		typedef struct Block Block;
+
+		struct Link
+		{
+			int rank;
+			bool pending;
+			Block own;						// Own cells the neighbour keeps as ghosts
+			Block ghost;					// Ghost cells owned by the neighbour
+			int size;
+			std::vector<char> reference;	// Own block as the neighbour has it
+			std::vector<char> ghostCells;	// Ghost block as received, before local writes
+			std::vector<char> sendBuffer;	// Own block + written ghost block
+			std::vector<char> recvBuffer;
+			std::vector<char> scratch;
+			std::vector<int> lost;
+			MPI_Request sendRequest;
+			MPI_Request recvRequest;
+		};
+		typedef struct Link Link;
+
+		static const int NUM_LINKS = 9;
+
+		static int LinkIndex(int dx, int dz);
+		static void Pack(CellGrid3D &grid, const Block &block, char *buffer);
+		static void Unpack(CellGrid3D &grid, const Block &block, const char *buffer);
+		void Receive(CellGrid3D &grid, Link &link);
+
+		// Write value to the own cell nearest (x, y, z) holding replaced - nearest column
+		// first (rings of columns around x, z), then nearest row in it
+		static void Relocate(CellGrid3D &grid, int x, int y, int z, char value, char replaced);
+
+		MPI_Comm m_comm;
+		std::string m_moved;
+		Link m_links[NUM_LINKS];	// Indexed by LinkIndex(), centre unused
+};
+
+#endif
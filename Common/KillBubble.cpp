@@ -0,0 +1,90 @@
+
+#include "KillBubble.h"
+#include <cmath>
+#include <stdexcept>
+
+KillBubble::KillBubble()
+{
+	m_mode = BERNOULLI;
+	m_probability = 0;
+	m_logSurvival = 0;
+	m_width = 0;
+	m_height = 0;
+	m_depth = 0;
+	m_wrapX = false;
+	m_wrapZ = false;
+}
+
+void KillBubble::Create(float probability, enum Mode mode, int width, int height, int depth, bool wrapX, bool wrapZ)
+{
+	m_mode = mode;
+	m_probability = probability;
+	m_logSurvival = probability < 1 ? log(1.0 - probability) : 0;
+	m_width = width;
+	m_height = height;
+	m_depth = depth;
+	m_wrapX = wrapX;
+	m_wrapZ = wrapZ;
+
+	m_life.clear();
+	if (m_mode == GEOMETRIC)
+		m_life.assign((long)width * height * depth, 0);
+}
+
+void KillBubble::Create(float probability, const std::string &mode, int width, int height, int depth, bool wrapX, bool wrapZ)
+{
+	if (mode == "bernoulli")
+		Create(probability, BERNOULLI, width, height, depth, wrapX, wrapZ);
+	else if (mode == "geometric")
+		Create(probability, GEOMETRIC, width, height, depth, wrapX, wrapZ);
+	else
+		throw std::invalid_argument("Invalid kill bubble mode '" + mode + "'");
+}
+
+enum KillBubble::Mode KillBubble::GetMode() const
+{
+	return m_mode;
+}
+
+int KillBubble::Moves(int x, int y, int z, int moves)
+{
+	if (m_mode == BERNOULLI)
+	{
+		for (int i = 0; i < moves; i++)
+		{
+			if (Random::Float() < m_probability)
+				return i;
+		}
+		return moves;
+	}
+
+	unsigned short &life = m_life[Index(x, y, z)];
+	if (life == 0)
+		life = Draw();
+	if (life == MAX_LIFE)
+		return moves;
+	if (life - 1 >= moves)
+	{
+		life -= moves;
+		return moves;
+	}
+
+	int made = life - 1;
+	life = 0;
+	return made;
+}
+
+unsigned short KillBubble::Draw() const
+{
+	if (m_probability >= 1)
+		return 1;
+	if (m_probability <= 0)
+		return MAX_LIFE;
+
+	// Moves survived before the first kill, by inversion: floor(log(U) / log(1 - p)).
+	// Voids with counts too long to store live forever (for p = 0.001, one in 10^28)
+	double moves = floor(log(1.0 - Random::Float()) / m_logSurvival);
+	if (moves >= MAX_LIFE - 1)
+		return MAX_LIFE;
+	return (unsigned short)moves + 1;
+}
@@ -0,0 +1,122 @@
+
+/*
+ * @file	KillBubble.h/.cpp
+ * @brief	Decides when a moving void stops and becomes a static void.
+ * @details	Every time a void moves it is killed with a fixed probability. In BERNOULLI
+ *			mode each move draws a random number to test for this. In GEOMETRIC mode a
+ *			void instead draws the number of moves it has left once, from the geometric
+ *			distribution the per-move test gives, and counts them down - the lifetime of
+ *			each void has the same distribution, with one random number per void rather
+ *			than one per move.
+ *			The moves left are kept per cell (2 bytes each, 0 for cells without a drawn
+ *			lifetime), and must follow the voids: Move() when a void moves, ShiftDown()
+ *			when a column is shifted down. As the geometric distribution is memoryless,
+ *			a void whose count is lost (e.g. moved outside the grid, or after resuming
+ *			from a checkpoint) draws a new one without changing the statistics.
+ *			Cells of different columns are independent, so tiles may be updated
+ *			concurrently (see TileSchedule).
+ * @author	Matt Drage
+ * @date	25/03/2013
+ */
+
+#ifndef KILLBUBBLE_H
+#define KILLBUBBLE_H
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include "Random.h"
+
+class KillBubble
+{
+	public:
+		enum Mode { BERNOULLI, GEOMETRIC };
+
+		// Voids with this many moves left are never killed
+		static const unsigned short MAX_LIFE = 0xFFFF;
+
+		// Constructors
+		KillBubble();
+
+		// Kill probability per move, and grid size (GEOMETRIC mode only)
+		void Create(float probability, enum Mode mode, int width, int height, int depth, bool wrapX, bool wrapZ);
+		void Create(float probability, const std::string &mode, int width, int height, int depth, bool wrapX, bool wrapZ);
+		enum Mode GetMode() const;
+
+		// True if the void at (x, y, z), about to move, is killed instead
+		bool Kill(int x, int y, int z)
+		{
+			if (m_mode == BERNOULLI)
+				return Random::Float() < m_probability;
+
+			unsigned short &life = m_life[Index(x, y, z)];
+			if (life == 0)
+				life = Draw();
+			if (life == 1)
+			{
+				life = 0;
+				return true;
+			}
+			if (life != MAX_LIFE)
+				life--;
+			return false;
+		}
+
+		// Number of the next 'moves' moves the void at (x, y, z) makes before it is
+		// killed - less than moves if it is killed on the way (see VoidJumps)
+		int Moves(int x, int y, int z, int moves);
+
+		// The void at (x, y, z) moved to (tx, ty, tz)
+		void Move(int x, int y, int z, int tx, int ty, int tz)
+		{
+			if (m_mode == BERNOULLI)
+				return;
+
+			long from = Index(x, y, z);
+			long to = Index(tx, ty, tz);
+			if (to >= 0)
+				m_life[to] = m_life[from];
+			m_life[from] = 0;
+		}
+
+		// Column (x, z) was shifted down from y - 1 up (see CellGrid3D::ShiftDown())
+		void ShiftDown(int x, int y, int z)
+		{
+			if (m_mode == BERNOULLI)
+				return;
+
+			// A void shifted out of the bottom of the grid is dropped
+			int start = y > 0 ? y - 1 : 0;
+			unsigned short *column = &m_life[Index(x, 0, z)];
+			memmove(column + start, column + start + 1, (m_height - 1 - start) * sizeof(unsigned short));
+			column[m_height - 1] = 0;
+		}
+
+	private:
+		// Moves left plus one
+		unsigned short Draw() const;
+
+		// Offset of a cell in m_life (columns contiguous), -1 outside the grid
+		long Index(int x, int y, int z) const
+		{
+			if (m_wrapX)
+				x = ((x % m_width) + m_width) % m_width;
+			if (m_wrapZ)
+				z = ((z % m_depth) + m_depth) % m_depth;
+			if ((unsigned int)x >= (unsigned int)m_width || (unsigned int)y >= (unsigned int)m_height || (unsigned int)z >= (unsigned int)m_depth)
+				return -1;
+			return ((long)x * m_depth + z) * m_height + y;
+		}
+
+		enum Mode m_mode;
+		float m_probability;
+		float m_logSurvival;
+		int m_width;
+		int m_height;
+		int m_depth;
+		bool m_wrapX;
+		bool m_wrapZ;
+		std::vector<unsigned short> m_life;
+};
+
+#endif
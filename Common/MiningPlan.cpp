@@ -0,0 +1,89 @@
+
+#include "MiningPlan.h"
+#include <cmath>
+#include <string>
+
+MiningPlan::MiningPlan()
+{
+	m_originX = 0;
+	m_originZ = 0;
+}
+
+void MiningPlan::Load(Xml &xml, const Vector3 &resolution)
+{
+	m_panels.clear();
+	Xml::Element *e = xml.root.Find("MiningPlan");
+	if (e == NULL)
+		return;
+
+	for (Xml::ElementListType::iterator i = e->subElements.begin(); i != e->subElements.end(); i++)
+	{
+		if ((*i)->name != "Panel")
+			continue;
+
+		Vector3 position = (*i)->Get<Vector3>("Position") * resolution;
+		Vector3 size = (*i)->Get<Vector3>("Dimensions") * resolution;
+		Panel panel;
+		panel.x0 = position.x;
+		panel.y0 = position.y;
+		panel.z0 = position.z;
+		panel.x1 = panel.x0 + (int)ceil(size.x);
+		panel.y1 = panel.y0 + (int)ceil(size.y);
+		panel.z1 = panel.z0 + (int)ceil(size.z);
+
+		// +x, -x, +z or -z (the sign may be left out)
+		std::string direction = (*i)->Get<std::string>("Direction", "+x");
+		panel.axis = direction[direction.size() - 1] == 'z' ? CellGrid3D::Z_AXIS : CellGrid3D::X_AXIS;
+		panel.direction = direction[0] == '-' ? -1 : 1;
+
+		// Rate in config units per iteration, a panel without a start follows the last
+		float scale = panel.axis == CellGrid3D::X_AXIS ? resolution.x : resolution.z;
+		panel.rate = (*i)->Get<float>("Rate", 1.0f) * scale;
+		panel.start = (*i)->Get<int>("Start", GetLastIteration() + 1);
+		AddPanel(panel);
+	}
+}
+
+void MiningPlan::AddPanel(const Panel &panel)
+{
+	if (panel.rate > 0 && panel.start > 0 && Length(panel) > 0)
+		m_panels.push_back(panel);
+}
+
+int MiningPlan::GetNumPanels() const
+{
+	return m_panels.size();
+}
+
+unsigned int MiningPlan::GetLastIteration() const
+{
+	unsigned int last = 0;
+	for (unsigned int i = 0; i < m_panels.size(); i++)
+	{
+		const Panel &panel = m_panels[i];
+		unsigned int iterations = (unsigned int)ceil(Length(panel) / panel.rate - 1e-9);
+		last = Max(last, panel.start + iterations - 1);
+	}
+	return last;
+}
+
+void MiningPlan::SetOrigin(int x, int z)
+{
+	m_originX = x;
+	m_originZ = z;
+}
+
+int MiningPlan::Length(const Panel &panel)
+{
+	return panel.axis == CellGrid3D::X_AXIS ? panel.x1 - panel.x0 : panel.z1 - panel.z0;
+}
+
+int MiningPlan::Mined(const Panel &panel, unsigned int iteration)
+{
+	if (iteration < panel.start)
+		return 0;
+
+	// The small margin keeps whole numbers of slices from rounding down
+	double slices = (iteration - panel.start + 1) * panel.rate + 1e-9;
+	return (int)Min(floor(slices), (double)Length(panel));
+}
@@ -0,0 +1,127 @@
+
+/*
+ * @file	MiningPlan.h/.cpp
+ * @brief	Schedule of longwall panels extracted during a 3D simulation.
+ * @details	Each panel is a box of cells mined by a face across the whole panel, which
+ *			advances along x or z from one end of the panel to the other at a fixed rate
+ *			(cells per iteration, may be fractional) from a start iteration. Panels in
+ *			several seams, or extracted one after the other, are separate panels.
+ *			Advance() extracts the slices of every panel its face passes in an iteration
+ *			(see CellRules::Extract() - fuel becomes voids), so a face costs its own area
+ *			per iteration and no sweep is needed to find it. The face position is a
+ *			function of the iteration alone, so a run resumed from a checkpoint carries
+ *			on where it left off.
+ *			Panels replace drill cells: a config with a MiningPlan needs no drill
+ *			regions (drill cells still follow the drill rule if there are any).
+ *			Positions are in cells of the whole grid; SetOrigin() gives the position of
+ *			a block (see CellRules::SetOrigin()), and only cells inside the block are
+ *			extracted.
+ * @author	Matt Drage
+ * @date	25/03/2013
+ */
+
+#ifndef MININGPLAN_H
+#define MININGPLAN_H
+
+#include <vector>
+#include "CellGrid3D.h"
+#include "CellRules.h"
+#include "MathUtils.h"
+#include "Xml.h"
+
+// Cells [x0, x1) x [y0, y1) x [z0, z1), mined along 'axis' (X_AXIS or Z_AXIS) in
+// 'direction' (+1 or -1)
+struct Panel
+{
+	int x0, x1;
+	int y0, y1;
+	int z0, z1;
+	enum CellGrid3D::Axis axis;
+	int direction;
+	double rate;
+	unsigned int start;
+};
+typedef struct Panel Panel;
+
+class MiningPlan
+{
+	public:
+		// Constructors
+		MiningPlan();
+
+		// Read the MiningPlan element of a config file (if any), positions are scaled by
+		// the grid resolution as for regions
+		void Load(Xml &xml, const Vector3 &resolution);
+		void AddPanel(const Panel &panel);
+		int GetNumPanels() const;
+
+		// Last iteration a face advances in (0 without panels)
+		unsigned int GetLastIteration() const;
+
+		// Position of the grid's cell (0, 0, 0) in the whole grid
+		void SetOrigin(int x, int z);
+
+		// Extract the slices the faces pass in 'iteration', telling observer about every
+		// changed cell (see CellRules). Returns the number of cells extracted.
+		template<typename Grid, typename Observer>
+		long Advance(Grid &grid, CellRules &rules, unsigned int iteration, Observer &observer)
+		{
+			long count = 0;
+			for (unsigned int i = 0; i < m_panels.size(); i++)
+			{
+				const Panel &panel = m_panels[i];
+				int last = Mined(panel, iteration);
+				for (int slice = Mined(panel, iteration - 1); slice < last; slice++)
+					count += Extract(grid, rules, panel, slice, observer);
+			}
+			return count;
+		}
+
+	private:
+		static int Length(const Panel &panel);
+
+		// Slices of a panel mined by the end of 'iteration'
+		static int Mined(const Panel &panel, unsigned int iteration);
+
+		// Extract the cells of a slice inside the grid, from the top down
+		template<typename Grid, typename Observer>
+		long Extract(Grid &grid, CellRules &rules, const Panel &panel, int slice, Observer &observer)
+		{
+			int x0 = panel.x0, x1 = panel.x1;
+			int z0 = panel.z0, z1 = panel.z1;
+			if (panel.axis == CellGrid3D::X_AXIS)
+			{
+				x0 = panel.direction > 0 ? panel.x0 + slice : panel.x1 - 1 - slice;
+				x1 = x0 + 1;
+			}
+			else
+			{
+				z0 = panel.direction > 0 ? panel.z0 + slice : panel.z1 - 1 - slice;
+				z1 = z0 + 1;
+			}
+
+			x0 = Max(x0 - m_originX, 0);
+			x1 = Min(x1 - m_originX, grid.GetWidth());
+			z0 = Max(z0 - m_originZ, 0);
+			z1 = Min(z1 - m_originZ, grid.GetDepth());
+			int y0 = Max(panel.y0, 0);
+			int y1 = Min(panel.y1, grid.GetHeight());
+
+			long count = 0;
+			for (int x = x0; x < x1; x++)
+			{
+				for (int z = z0; z < z1; z++)
+				{
+					for (int y = y1 - 1; y >= y0; y--)
+						count += rules.Extract(grid, x, y, z, observer);
+				}
+			}
+			return count;
+		}
+
+		std::vector<Panel> m_panels;
+		int m_originX;
+		int m_originZ;
+};
+
+#endif
@@ -0,0 +1,406 @@
+
+#include "PackedCellGrid3D.h"
+#include "MathUtils.h"
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+
+static const unsigned char NO_CODE = 0xFF;
+static const PackedCellGrid3D::Word LOW_BITS = 0x1111111111111111ULL;
+
+PackedCellGrid3D::PackedCellGrid3D()
+{
+	m_width = 0;
+	m_height = 0;
+	m_depth = 0;
+	m_halo = 0;
+	m_wordsPerLine = 0;
+	m_lineStrideY = 0;
+	m_data = NULL;
+	m_dummy = 0;
+	SetValues("");
+	for (int i = 0; i < 6; i++)
+	{
+		m_boundMode[i] = CellGrid3D::WRAP;
+		m_border[i] = 0;
+	}
+}
+
+PackedCellGrid3D::~PackedCellGrid3D()
+{
+	delete[] m_data;
+	m_data = NULL;
+}
+
+void PackedCellGrid3D::SetValues(const std::string &values)
+{
+	if ((int)values.size() >= MAX_VALUES)
+		throw std::invalid_argument("Too many cell values for packed grid");
+
+	memset(m_values, 0, sizeof(m_values));
+	memset(m_codes, NO_CODE, sizeof(m_codes));
+	m_codes[0] = 0;
+	for (unsigned int i = 0; i < values.size(); i++)
+	{
+		m_values[i + 1] = values[i];
+		m_codes[(unsigned char)values[i]] = i + 1;
+	}
+}
+
+bool PackedCellGrid3D::SetSize(int width, int height, int depth)
+{
+	delete[] m_data;
+	m_data = NULL;
+
+	m_width = width;
+	m_height = height;
+	m_depth = depth;
+	m_wordsPerLine = (m_depth + 2 * m_halo + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+	m_lineStrideY = (long)(m_width + 2 * m_halo) * m_wordsPerLine;
+
+	try
+	{
+		long words = (m_height + 2 * m_halo) * m_lineStrideY;
+		m_data = new Word[words];
+
+		// Ignore faces of the halo start out empty, border faces hold the border value
+		memset(m_data, 0, words * sizeof(Word));
+		ResetHalo();
+		return true;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+bool PackedCellGrid3D::SetSize(const Vector3 &size)
+{
+	return SetSize(size.x, size.y, size.z);
+}
+
+int PackedCellGrid3D::GetWidth() const
+{
+	return m_width;
+}
+
+int PackedCellGrid3D::GetHeight() const
+{
+	return m_height;
+}
+
+int PackedCellGrid3D::GetDepth() const
+{
+	return m_depth;
+}
+
+void PackedCellGrid3D::SetHalo(int size)
+{
+	m_halo = size;
+	if (m_data)
+		SetSize(m_width, m_height, m_depth);
+}
+
+int PackedCellGrid3D::GetHalo() const
+{
+	return m_halo;
+}
+
+void PackedCellGrid3D::ResetHalo()
+{
+	// x faces are filled last so they take precedence on the edges (matches ApplyBounds)
+	static const enum CellGrid3D::Border order[6] = { CellGrid3D::FRONT, CellGrid3D::BACK, CellGrid3D::BOTTOM, CellGrid3D::TOP, CellGrid3D::LEFT, CellGrid3D::RIGHT };
+	for (int i = 0; i < 6; i++)
+	{
+		if (m_boundMode[order[i]] == CellGrid3D::BORDER)
+			FillHalo(order[i]);
+	}
+}
+
+void PackedCellGrid3D::FillHalo(enum CellGrid3D::Border border)
+{
+	if (m_halo == 0 || m_data == NULL)
+		return;
+
+	int x0 = -m_halo, x1 = m_width + m_halo;
+	int y0 = -m_halo, y1 = m_height + m_halo;
+	int z0 = -m_halo, z1 = m_depth + m_halo;
+	switch (border)
+	{
+		case CellGrid3D::LEFT:		x1 = 0;			break;
+		case CellGrid3D::RIGHT:		x0 = m_width;	break;
+		case CellGrid3D::BOTTOM:	y1 = 0;			break;
+		case CellGrid3D::TOP:		y0 = m_height;	break;
+		case CellGrid3D::FRONT:		z1 = 0;			break;
+		case CellGrid3D::BACK:		z0 = m_depth;	break;
+	}
+
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+			FillLine(x, y, z0, z1, m_border[border]);
+	}
+}
+
+void PackedCellGrid3D::SetBoundMode(enum CellGrid3D::BoundMode mode, char option)
+{
+	for (int i = 0; i < 6; i++)
+		m_boundMode[i] = mode;
+
+	if (mode == CellGrid3D::BORDER)
+	{
+		for (int i = 0; i < 6; i++)
+			m_border[i] = option;
+		ResetHalo();
+	}
+}
+
+void PackedCellGrid3D::SetBoundMode(enum CellGrid3D::BoundMode mode, enum CellGrid3D::Border border, char option)
+{
+	m_boundMode[border] = mode;
+	if (mode == CellGrid3D::BORDER)
+	{
+		m_border[border] = option;
+		ResetHalo();
+	}
+}
+
+void PackedCellGrid3D::SetBoundMode(const std::string &mode, enum CellGrid3D::Border border)
+{
+	if (mode == "exception")
+		m_boundMode[border] = CellGrid3D::EXCEPTION;
+	else if (mode == "ignore")
+		m_boundMode[border] = CellGrid3D::IGNORE;
+	else if (mode == "wrap")
+		m_boundMode[border] = CellGrid3D::WRAP;
+	else if (mode.substr(0, 6) == "border")
+	{
+		m_boundMode[border] = CellGrid3D::BORDER;
+		m_border[border] = mode[7];
+		ResetHalo();
+	}
+}
+
+enum CellGrid3D::BoundMode PackedCellGrid3D::GetBoundMode(enum CellGrid3D::Border border) const
+{
+	return m_boundMode[border];
+}
+
+char PackedCellGrid3D::GetBorderValue(enum CellGrid3D::Border border) const
+{
+	return m_border[border];
+}
+
+bool PackedCellGrid3D::ApplyBound(int &i, int size, enum CellGrid3D::Border low, enum CellGrid3D::Border high) const
+{
+	int b = i < 0 ? low : high;
+	switch (m_boundMode[b])
+	{
+		case CellGrid3D::WRAP:
+			i = ((i % size) + size) % size;
+			return false;
+		case CellGrid3D::EXCEPTION:
+			throw std::out_of_range("Invalid cell index");
+		case CellGrid3D::BORDER:
+			m_dummy = m_border[b];
+			break;
+		case CellGrid3D::IGNORE:
+			break;
+	}
+
+	// Cells inside the halo are stored, any further out are redirected to the dummy cell
+	return i < -m_halo || i >= size + m_halo;
+}
+
+bool PackedCellGrid3D::ApplyBounds(int &x, int &y, int &z) const
+{
+	if ((x >= m_width || x < 0) && ApplyBound(x, m_width, CellGrid3D::LEFT, CellGrid3D::RIGHT))
+		return true;
+	if ((y >= m_height || y < 0) && ApplyBound(y, m_height, CellGrid3D::BOTTOM, CellGrid3D::TOP))
+		return true;
+	if ((z >= m_depth || z < 0) && ApplyBound(z, m_depth, CellGrid3D::FRONT, CellGrid3D::BACK))
+		return true;
+	return false;
+}
+
+unsigned char PackedCellGrid3D::Code(char value) const
+{
+	unsigned char code = m_codes[(unsigned char)value];
+	if (code == NO_CODE)
+		throw std::invalid_argument("Cell value not in packed grid palette");
+	return code;
+}
+
+void PackedCellGrid3D::Set(long word, int shift, char value)
+{
+	if (word < 0)
+	{
+		m_dummy = value;
+		return;
+	}
+
+	Word code = (Word)Code(value) << shift;
+	Word mask = (Word)0xF << shift;
+	Word current, updated;
+	do
+	{
+		current = m_data[word];
+		updated = (current & ~mask) | code;
+	}
+	while (!__sync_bool_compare_and_swap(&m_data[word], current, updated));
+}
+
+void PackedCellGrid3D::FillLine(int x, int y, int z0, int z1, char value)
+{
+	Word code = Code(value);
+	Word pattern = code * LOW_BITS;
+	Word *line = m_data + (y + m_halo) * m_lineStrideY + (x + m_halo) * m_wordsPerLine;
+
+	int zz = z0 + m_halo;
+	int end = z1 + m_halo;
+	while (zz < end)
+	{
+		// Whole words at once, partial words a nibble at a time
+		int offset = zz % CELLS_PER_WORD;
+		if (offset == 0 && end - zz >= CELLS_PER_WORD)
+		{
+			line[zz / CELLS_PER_WORD] = pattern;
+			zz += CELLS_PER_WORD;
+		}
+		else
+		{
+			Word mask = (Word)0xF << (4 * offset);
+			Word &word = line[zz / CELLS_PER_WORD];
+			word = (word & ~mask) | (code << (4 * offset));
+			zz++;
+		}
+	}
+}
+
+void PackedCellGrid3D::Fill(char value)
+{
+	Fill(value, 0, m_width);
+}
+
+void PackedCellGrid3D::Fill(char value, int x0, int x1)
+{
+	for (int y = 0; y < m_height; y++)
+	{
+		for (int x = x0; x < x1; x++)
+			FillLine(x, y, 0, m_depth, value);
+	}
+}
+
+void PackedCellGrid3D::Fill(int x, int y, int z, int width, int height, int depth, char value)
+{
+	// See CellGrid3D::Fill() - lines inside the grid a word at a time
+	int x0 = Max(x, 0), x1 = Min(x + width, m_width);
+	int y0 = Max(y, 0), y1 = Min(y + height, m_height);
+	int z0 = Max(z, 0), z1 = Min(z + depth, m_depth);
+	if (x0 >= x1 || y0 >= y1 || z0 >= z1)
+	{
+		FillCells(x, y, z, x + width, y + height, z + depth, value);
+		return;
+	}
+	
+	for (int cy = y0; cy < y1; cy++)
+	{
+		for (int cx = x0; cx < x1; cx++)
+			FillLine(cx, cy, z0, z1, value);
+	}
+	FillCells(x, y, z, x + width, y0, z + depth, value);
+	FillCells(x, y1, z, x + width, y + height, z + depth, value);
+	FillCells(x, y0, z, x0, y1, z + depth, value);
+	FillCells(x1, y0, z, x + width, y1, z + depth, value);
+	FillCells(x0, y0, z, x1, y1, z0, value);
+	FillCells(x0, y0, z1, x1, y1, z + depth, value);
+}
+
+void PackedCellGrid3D::FillCells(int x0, int y0, int z0, int x1, int y1, int z1, char value)
+{
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			for (int z = z0; z < z1; z++)
+				(*this)(x, y, z) = value;
+		}
+	}
+}
+
+void PackedCellGrid3D::Fill(const Vector3 &position, const Vector3 &dimensions, char value)
+{
+	Fill(position.x, position.y, position.z, ceil(dimensions.x), ceil(dimensions.y), ceil(dimensions.z), value);
+}
+
+void PackedCellGrid3D::ShiftDown(int x, int y, int z)
+{
+	int i = y - 1;
+	if ((unsigned int)x < (unsigned int)m_width && (unsigned int)z < (unsigned int)m_depth && i >= 0)
+	{
+		// The column is the same nibble of one word per y, so codes are moved between
+		// words without decoding them. Only the thread updating the column writes its
+		// nibble, so the change is applied with a single XOR rather than a CAS loop
+		int shift;
+		Word *word = m_data + Locate(x, i, z, shift);
+		for (; i < m_height - 1; i++, word += m_lineStrideY)
+		{
+			Word change = (word[0] ^ word[m_lineStrideY]) & ((Word)0xF << shift);
+			if (change)
+				__sync_fetch_and_xor(word, change);
+		}
+	}
+	
+	// Cells above the top go through the bounds logic
+	for (; i < m_height; i++)
+		(*this)(x, i, z) = (*this)(x, i + 1, z);
+}
+
+void PackedCellGrid3D::Match(int x, int y, const std::string &values, std::vector<Word> &mask) const
+{
+	int shift;
+	const Word *line = m_data + Locate(x, y, 0, shift) - m_halo / CELLS_PER_WORD;
+
+	std::vector<Word> patterns(values.size());
+	for (unsigned int v = 0; v < values.size(); v++)
+		patterns[v] = Code(values[v]) * LOW_BITS;
+
+	// Bit i of matches is set for stored cell i of the line, including the halo
+	std::vector<Word> matches((m_wordsPerLine + 3) / 4 + 1, 0);
+	for (long w = 0; w < m_wordsPerLine; w++)
+	{
+		Word found = 0;
+		for (unsigned int v = 0; v < patterns.size(); v++)
+		{
+			// Nibbles equal to the code become zero, any set bit marks a mismatch
+			Word diff = line[w] ^ patterns[v];
+			diff |= (diff >> 1) | (diff >> 2) | (diff >> 3);
+			found |= ~diff & LOW_BITS;
+		}
+
+		// Gather the low bit of each nibble into 16 consecutive bits
+		found = (found | (found >> 3)) & 0x0303030303030303ULL;
+		found = (found | (found >> 6)) & 0x000F000F000F000FULL;
+		found = (found | (found >> 12)) & 0x000000FF000000FFULL;
+		found = (found | (found >> 24)) & 0xFFFFULL;
+		matches[w / 4] |= found << (16 * (w % 4));
+	}
+
+	// Drop the front halo cells, then any cells past the back of the grid
+	int offset = m_halo / 64;
+	int bit = m_halo % 64;
+	mask.resize((m_depth + 63) / 64);
+	for (unsigned int i = 0; i < mask.size(); i++)
+	{
+		mask[i] = matches[i + offset] >> bit;
+		if (bit > 0)
+			mask[i] |= matches[i + offset + 1] << (64 - bit);
+	}
+	if (m_depth % 64 != 0)
+		mask.back() &= ((Word)1 << (m_depth % 64)) - 1;
+}
+
+long PackedCellGrid3D::GetStorageSize() const
+{
+	return (m_height + 2 * m_halo) * m_lineStrideY * sizeof(Word);
+}
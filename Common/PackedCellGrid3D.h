@@ -0,0 +1,196 @@
+
+/*
+ * @file	PackedCellGrid3D.h/.cpp
+ * @brief	Stores 3D cellular automata data in 4 bits per cell.
+ * @details	A drop-in alternative to CellGrid3D for grids with at most 15 cell types,
+ *			using half the memory. Cell values are mapped to 4-bit codes by a palette set
+ *			with SetValues() before the grid is filled (code 0 is the value 0, which empty
+ *			halo cells hold). Storing a value that is not in the palette throws
+ *			std::invalid_argument.
+ *			Sizes, bound modes and the ghost halo behave exactly as in CellGrid3D, so a
+ *			simulation gives the same results with either grid.
+ *			Each x line of cells along z is stored in 64-bit words of 16 cells.
+ *			operator() returns a Cell reference object that reads and writes the packed
+ *			value, so templated update code works with both grids. Writes update the
+ *			whole word atomically, so tiles updated concurrently may share a word (see
+ *			TileSchedule).
+ *			ShiftDown() moves the codes of a column from word to word without decoding
+ *			them.
+ *			Match() tests a whole line against a set of values 16 cells at a time, e.g. to
+ *			find the cells that are AIR or STATIC_VOID.
+ *			DispatchBounds() passes the grid itself as both views, bounds are applied on
+ *			every access.
+ * @author	Matt Drage
+ * @date	11/03/2013
+ */
+
+#ifndef PACKEDCELLGRID3D_H
+#define PACKEDCELLGRID3D_H
+
+#include "CellGrid3D.h"
+#include <string>
+#include <vector>
+
+class PackedCellGrid3D
+{
+	public:
+		static const int MAX_VALUES = 16;
+		static const int CELLS_PER_WORD = 16;
+
+		typedef unsigned long long Word;
+
+		// Reference to a single packed cell
+		class Cell
+		{
+			public:
+				Cell(PackedCellGrid3D &grid, long word, int shift) : m_grid(grid), m_word(word), m_shift(shift) {}
+
+				operator char() const { return m_grid.Get(m_word, m_shift); }
+				Cell& operator=(char value) { m_grid.Set(m_word, m_shift, value); return *this; }
+				Cell& operator=(const Cell &other) { return *this = (char)other; }
+
+			private:
+				PackedCellGrid3D &m_grid;
+				long m_word;	// -1 for cells outside the grid and halo
+				int m_shift;
+		};
+
+		// Constructors & Destructors
+		PackedCellGrid3D();
+		virtual ~PackedCellGrid3D();
+
+		// Cell values that may be stored, at most MAX_VALUES - 1 (set before filling)
+		void SetValues(const std::string &values);
+
+		// Dimensions
+		bool SetSize(int width, int height, int depth);
+		bool SetSize(const Vector3 &size);
+		int GetWidth() const;
+		int GetHeight() const;
+		int GetDepth() const;
+
+		// Ghost halo (reallocates the grid, so set it before filling)
+		void SetHalo(int size);
+		int GetHalo() const;
+		void ResetHalo();
+
+		// Bound modes
+		void SetBoundMode(enum CellGrid3D::BoundMode mode, char option = 0);
+		void SetBoundMode(enum CellGrid3D::BoundMode mode, enum CellGrid3D::Border border, char option = 0);
+		void SetBoundMode(const std::string &mode, enum CellGrid3D::Border border);
+		enum CellGrid3D::BoundMode GetBoundMode(enum CellGrid3D::Border border) const;
+		char GetBorderValue(enum CellGrid3D::Border border) const;
+
+		// Cell access (inline, cells are accessed through a Cell on every update)
+		Cell operator()(int x, int y, int z)
+		{
+			int shift;
+			long word = Locate(x, y, z, shift);
+			return Cell(*this, word, shift);
+		}
+		
+		char operator()(int x, int y, int z) const
+		{
+			int shift;
+			long word = Locate(x, y, z, shift);
+			return Get(word, shift);
+		}
+		
+		Cell operator()(const Vector3 &position)
+		{
+			return (*this)(position.x, position.y, position.z);
+		}
+		
+		char operator()(const Vector3 &position) const
+		{
+			return (*this)(position.x, position.y, position.z);
+		}
+		
+		// See CellGrid3D::GetOffset() - packed cells are not a fixed distance apart in
+		// storage, so neighbours are always found from their coordinates
+		CellOffset GetOffset(int x, int y, int z) const
+		{
+			CellOffset offset = { x, y, z, 0 };
+			return offset;
+		}
+		
+		Cell Neighbour(int x, int y, int z, const CellOffset &offset)
+		{
+			return (*this)(x + offset.x, y + offset.y, z + offset.z);
+		}
+
+		// Cell value initialisation
+		void Fill(char value);
+		void Fill(char value, int x0, int x1);	// columns [x0, x1)
+		void Fill(int x, int y, int z, int width, int height, int depth, char value);
+		void Fill(const Vector3 &position, const Vector3 &dimensions, char value);
+
+		// See CellGrid3D::ShiftDown()
+		void ShiftDown(int x, int y, int z);
+
+		// Set bit z of mask for each cell (x, y, z) of a line inside the grid holding one
+		// of values (all in the palette)
+		void Match(int x, int y, const std::string &values, std::vector<Word> &mask) const;
+
+		// Size of the cell data in bytes
+		long GetStorageSize() const;
+
+	private:
+		friend class Cell;
+
+		char Get(long word, int shift) const
+		{
+			if (word < 0)
+				return m_dummy;
+			return m_values[(m_data[word] >> shift) & 0xF];
+		}
+		
+		void Set(long word, int shift, char value);
+		unsigned char Code(char value) const;
+		
+		long Locate(int x, int y, int z, int &shift) const
+		{
+			// Bounds logic only for cells outside the grid
+			if ((unsigned int)x >= (unsigned int)m_width || (unsigned int)y >= (unsigned int)m_height || (unsigned int)z >= (unsigned int)m_depth)
+			{
+				if (ApplyBounds(x, y, z))
+				{
+					shift = 0;
+					return -1;
+				}
+			}
+			
+			int zz = z + m_halo;
+			shift = 4 * (zz % CELLS_PER_WORD);
+			return (y + m_halo) * m_lineStrideY + (x + m_halo) * m_wordsPerLine + zz / CELLS_PER_WORD;
+		}
+		
+		bool ApplyBound(int &i, int size, enum CellGrid3D::Border low, enum CellGrid3D::Border high) const;
+		bool ApplyBounds(int &x, int &y, int &z) const;
+		void FillLine(int x, int y, int z0, int z1, char value);
+		void FillCells(int x0, int y0, int z0, int x1, int y1, int z1, char value);
+		void FillHalo(enum CellGrid3D::Border border);
+
+		int m_width;
+		int m_height;
+		int m_depth;
+		int m_halo;
+		long m_wordsPerLine;
+		long m_lineStrideY;
+		char m_values[MAX_VALUES];
+		unsigned char m_codes[256];
+		char m_border[6];
+		enum CellGrid3D::BoundMode m_boundMode[6];
+		Word *m_data;
+		mutable char m_dummy;
+};
+
+// Packed grids apply bounds on every access, there are no unchecked views
+template<typename Func>
+void DispatchBounds(PackedCellGrid3D &grid, Func &func, int reachX, int reachY, int reachZ)
+{
+	grid.ResetHalo();
+	func(grid, grid);
+}
+
+#endif
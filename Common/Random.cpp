@@ -6,32 +6,150 @@
 #include <limits>
 #include <cassert>
 
+// Philox4x32 constants
+static const unsigned int PHILOX_M0 = 0xD2511F53;
+static const unsigned int PHILOX_M1 = 0xCD9E8D57;
+static const unsigned int PHILOX_W0 = 0x9E3779B9;
+static const unsigned int PHILOX_W1 = 0xBB67AE85;
+static const int PHILOX_ROUNDS = 10;
+
+// Cell streams count blocks in the top byte of the y counter word
+static const unsigned int CELL_BLOCK_STEP = 1 << 24;
+
+// Default thread streams use an iteration no cell stream can have
+static const unsigned int THREAD_STREAM = 0xFFFFFFFF;
+
+typedef struct
+{
+	unsigned int counter[4];	// x, z, y + block, iteration
+	unsigned int output[4];
+	int used;
+	bool cell;
+	bool seeded;
+} Stream;
+
+static long globalSeed = 1;
+static int seededThreads = 0;
+static __thread Stream threadStream;
+
+static void Philox(const unsigned int counter[4], unsigned int output[4])
+{
+	unsigned int c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	unsigned int k0 = (unsigned int)globalSeed;
+	unsigned int k1 = (unsigned int)((unsigned long long)globalSeed >> 32);
+	
+	for (int i = 0; i < PHILOX_ROUNDS; i++)
+	{
+		unsigned long long p0 = (unsigned long long)PHILOX_M0 * c0;
+		unsigned long long p1 = (unsigned long long)PHILOX_M1 * c2;
+		c0 = (unsigned int)(p1 >> 32) ^ c1 ^ k0;
+		c1 = (unsigned int)p1;
+		c2 = (unsigned int)(p0 >> 32) ^ c3 ^ k1;
+		c3 = (unsigned int)p0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	
+	output[0] = c0;
+	output[1] = c1;
+	output[2] = c2;
+	output[3] = c3;
+}
+
+static void StartThreadStream(Stream &stream, unsigned int index)
+{
+	stream.counter[0] = index;
+	stream.counter[1] = 0;
+	stream.counter[2] = 0;
+	stream.counter[3] = THREAD_STREAM;
+	stream.used = 4;
+	stream.cell = false;
+	stream.seeded = true;
+}
+
 void Random::SetSeed()
 {
-	srand((long)time(NULL));
+	SetSeed((long)time(NULL));
 }
 
 void Random::SetSeed(long seed)
 {
-	srand(seed);
+	globalSeed = seed;
+	seededThreads = 0;
+	StartThreadStream(threadStream, 0);
+}
+
+long Random::GetSeed()
+{
+	return globalSeed;
+}
+
+void Random::SetStream(unsigned int iteration, int x, int y, int z)
+{
+	assert(x >= 0 && y >= 0 && z >= 0 && y < (int)CELL_BLOCK_STEP);
+	
+	Stream &stream = threadStream;
+	stream.counter[0] = x;
+	stream.counter[1] = z;
+	stream.counter[2] = y;
+	stream.counter[3] = iteration;
+	stream.used = 4;
+	stream.cell = true;
+	stream.seeded = true;
+}
+
+unsigned int Random::Hash(unsigned int iteration, int x, int y, int z)
+{
+	assert(x >= 0 && y >= 0 && z >= 0 && y < (int)CELL_BLOCK_STEP);
+	
+	unsigned int counter[4] = { (unsigned int)x, (unsigned int)z, y + 255 * CELL_BLOCK_STEP, iteration };
+	unsigned int output[4];
+	Philox(counter, output);
+	return output[3];
+}
+
+unsigned int Random::Next()
+{
+	Stream &stream = threadStream;
+	if (!stream.seeded)
+		StartThreadStream(stream, __sync_add_and_fetch(&seededThreads, 1));
+	
+	if (stream.used == 4)
+	{
+		Philox(stream.counter, stream.output);
+		stream.used = 0;
+		
+		if (stream.cell)
+			stream.counter[2] += CELL_BLOCK_STEP;
+		else if (++stream.counter[1] == 0)
+			stream.counter[2]++;
+	}
+	
+	return stream.output[stream.used++];
 }
 
 float Random::Float()
 {
-	return rand() / (float)RAND_MAX;
+	// 24 random bits - exactly representable as a float in [0, 1)
+	return (Next() >> 8) * (1.0f / 16777216.0f);
 }
 
 float Random::Float(float min, float max)
 {
-	return (rand() / (float)RAND_MAX) * (max - min) + min;
+	return Float() * (max - min) + min;
 }
 
 int Random::Int(int min, int max)
 {
-	return rand() % (max - min) + min;
+	return (int)(Next() % (unsigned int)(max - min)) + min;
 }
 
 bool Random::Bool()
 {
-	return rand() % 2 == 0;
+	return (Next() & 1) == 0;
+}
+
+unsigned int Random::UInt()
+{
+	return Next();
 }
@@ -2,6 +2,19 @@
 /*
  * @file	Random.h/.cpp
  * @brief	Pseudo-random number generation.
+ * @details	Numbers come from the Philox4x32-10 counter-based generator: each block of four
+ *			numbers is a keyed hash of a 128-bit counter, so there is no shared state and
+ *			any number in a stream can be generated independently of the others.
+ *			The key is the seed set by SetSeed(). Every thread draws from its own stream:
+ *				- by default, a stream unique to the thread (numbered in the order threads
+ *					first draw a number).
+ *				- after SetStream(iteration, x, y, z), the stream of a single cell update.
+ *					Cell updates draw the same numbers whichever thread or processor runs
+ *					them, so a simulation only depends on the seed and the update order.
+ *					A cell stream holds 1024 numbers. Coordinates must be non-negative,
+ *					y less than 2^24.
+ *			Hash() gives the last number of a cell stream without selecting it, a value
+ *			every thread agrees on for a cell (e.g. to settle conflicting updates).
  * @author	Matt Drage
  * @date	05/12/2012
  */
@@ -14,10 +27,23 @@ class Random
 	public:
 		static void SetSeed();
 		static void SetSeed(long seed);
+		static long GetSeed();
+		
+		// Select the stream of cell (x, y, z) in an iteration for the calling thread
+		static void SetStream(unsigned int iteration, int x, int y, int z);
+		
+		// Last number of the stream of cell (x, y, z) in an iteration (cell updates never
+		// draw that many), leaving the calling thread's stream as it is
+		static unsigned int Hash(unsigned int iteration, int x, int y, int z);
+		
 		static float Float();
 		static float Float(float min, float max);
 		static int Int(int min, int max);
 		static bool Bool();
+		static unsigned int UInt();
+		
+	private:
+		static unsigned int Next();
 };
 
 #endif
@@ -12,6 +12,15 @@ void GenerateSelectionSet(SelectionSet<int> &s, double mean, double variance, in
 	double stdDev = sqrt(variance);
 	for (int x = xMin; x <= xMax; x++)
 		s.Add(Gaussian(x, mean, stdDev), x);
+	s.BuildAliasTable();
+}
+
+void GenerateSelectionSet(SelectionSet<Vector3> &s, double mean, double variance, int xMin, int xMax)
+{
+	double stdDev = sqrt(variance);
+	for (int x = xMin; x <= xMax; x++)
+		s.Add(Gaussian(x, mean, stdDev), Vector3(x, 1, 0));
+	s.BuildAliasTable();
 }
 
 double BivariateGaussian(double x, double y, double ma, double mb, double sa, double sb)
@@ -32,6 +41,7 @@ void GenerateSelectionSet(SelectionSet<Vector3> &s, double mx, double mz, double
 			s.Add(p, Vector3(x, 1, z));
 		}
 	}
+	s.BuildAliasTable();
 }
 
 void GenerateSelectionSet(SelectionSet<Vector3> &s, const Vector2 &mean, const Vector2 &variance, int r)
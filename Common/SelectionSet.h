@@ -4,6 +4,9 @@
  * @brief	Random roulette selection from a set a values.
  * @details	Selects values using roulette-wheel style selection (uses cumulative probability).
  *			Probability of all items added does not have to equal 1.
+ *			BuildAliasTable() switches to Vose's alias method: each selection takes one
+ *			random number and constant time, whatever the size of the set. Adding items
+ *			afterwards reverts to the cumulative search until the table is rebuilt.
  *			2D and 3D sets can be generated using gaussian probability distributions.
  * @author	Matt Drage
  * @date	05/12/2012
@@ -33,6 +36,8 @@ class SelectionSet
 			m_total = 0;
 			m_cumulativeProb.clear();
 			m_values.clear();
+			m_alias.clear();
+			m_threshold.clear();
 		}
 		
 		int GetSetSize() const
@@ -40,36 +45,116 @@ class SelectionSet
 			return m_setSize;
 		}
 		
+		// Item i and its probability (relative to the other items)
+		const T& GetValue(int i) const
+		{
+			return m_values[i];
+		}
+		
+		double GetProbability(int i) const
+		{
+			return m_cumulativeProb[i] - (i > 0 ? m_cumulativeProb[i - 1] : 0);
+		}
+		
 		void Add(double probability, T value)
 		{
 			m_setSize++;
 			m_total += probability;
 			m_cumulativeProb.push_back(m_total);
 			m_values.push_back(value);
+			m_alias.clear();
+			m_threshold.clear();
+		}
+		
+		// Split the set into equal columns of one or two items (Vose's alias method)
+		void BuildAliasTable()
+		{
+			m_alias.resize(m_setSize);
+			m_threshold.resize(m_setSize);
+			
+			// Probabilities scaled so the average is 1
+			std::vector<double> scaled(m_setSize);
+			std::vector<int> small, large;
+			for (int i = 0; i < m_setSize; i++)
+			{
+				double p = m_cumulativeProb[i] - (i > 0 ? m_cumulativeProb[i - 1] : 0);
+				scaled[i] = p * m_setSize / m_total;
+				if (scaled[i] < 1)
+					small.push_back(i);
+				else
+					large.push_back(i);
+			}
+			
+			// Fill each small item's column with part of a large item
+			std::vector<double> threshold(m_setSize, 1.0);
+			for (int i = 0; i < m_setSize; i++)
+				m_alias[i] = i;
+			while (!small.empty() && !large.empty())
+			{
+				int s = small.back();
+				int l = large.back();
+				small.pop_back();
+				threshold[s] = scaled[s];
+				m_alias[s] = l;
+				scaled[l] -= 1 - scaled[s];
+				if (scaled[l] < 1)
+				{
+					large.pop_back();
+					small.push_back(l);
+				}
+			}
+			
+			// Thresholds as 32-bit fractions, compared with the low word of the draw
+			for (int i = 0; i < m_setSize; i++)
+				m_threshold[i] = (threshold[i] >= 1) ? 0xFFFFFFFF : (unsigned int)(threshold[i] * 4294967296.0);
 		}
 		
 		T RouletteSelect()
 		{
-			float r = Random::Float(0, m_total);
+			return m_values[RouletteSelectIndex()];
+		}
+		
+		// Index of the selected item (see GetValue())
+		int RouletteSelectIndex()
+		{
+			if (!m_alias.empty())
+			{
+				// High word picks the column, low word the item in it
+				unsigned long long r = (unsigned long long)Random::UInt() * m_setSize;
+				int i = (int)(r >> 32);
+				return (unsigned int)r < m_threshold[i] ? i : m_alias[i];
+			}
+			
+			double r = Random::Float(0, m_total);
 			for (int i = 0; i < m_setSize; i++)
 			{
 				if (r < m_cumulativeProb[i])
-					return m_values[i];
+					return i;
 			}
-			return m_values[m_setSize - 1];
+			return m_setSize - 1;
+		}
+		
+		// Select count values into out
+		void RouletteSelect(int count, T *out)
+		{
+			for (int i = 0; i < count; i++)
+				out[i] = RouletteSelect();
 		}
 		
 	private:
 		int m_setSize;
-		float m_total;
+		double m_total;
 		std::vector<double> m_cumulativeProb;
 		std::vector<T> m_values;
+		std::vector<int> m_alias;
+		std::vector<unsigned int> m_threshold;
 };
 
 // Populate selection set using Guassian distribution
 double Gaussian(double x, double m, double s);
 double BivariateGaussian(double x, double y, double ma, double mb, double sa, double sb);
 void GenerateSelectionSet(SelectionSet<int> &s, double mean, double variance, int xMin, int xMax);
+void GenerateSelectionSet(SelectionSet<Vector3> &s, double mean, double variance, int xMin, int xMax);	// offsets (x, 1, 0)
 void GenerateSelectionSet(SelectionSet<Vector3> &s, double mx, double mz, double vx, double vz, int r);
 void GenerateSelectionSet(SelectionSet<Vector3> &s, const Vector2 &mean, const Vector2 &variance, int r);
 
@@ -0,0 +1,39 @@
+
+#include "SurfaceIndex.h"
+
+SurfaceIndex::SurfaceIndex()
+{
+	m_width = 0;
+	m_depth = 0;
+	m_value = 0;
+}
+
+SurfaceIndex::SurfaceIndex(int width, int depth, char value)
+{
+	Create(width, depth, value);
+}
+
+void SurfaceIndex::Create(int width, int depth, char value)
+{
+	m_width = width;
+	m_depth = depth;
+	m_value = value;
+	m_height.assign(width * depth, -1);
+}
+
+int SurfaceIndex::operator()(int x, int z) const
+{
+	return m_height[x * m_depth + z];
+}
+
+void SurfaceIndex::CopyTo(Heightmap &hmap) const
+{
+	if (hmap.GetWidth() != m_width || hmap.GetDepth() != m_depth)
+		hmap.SetSize(m_width, m_depth);
+
+	for (int x = 0; x < m_width; x++)
+	{
+		for (int z = 0; z < m_depth; z++)
+			hmap(x, z) = m_height[x * m_depth + z];
+	}
+}
@@ -0,0 +1,83 @@
+
+/*
+ * @file	SurfaceIndex.h/.cpp
+ * @brief	Keeps the surface height of every column of a 3D cell grid.
+ * @details	The surface of a column is its highest cell holding the surface value (e.g.
+ *			earth), or -1 if there is none. Heights are found by scanning columns down
+ *			from the top. After an iteration only the columns of tiles that were updated
+ *			(see ActiveTiles) can have changed, so only those need to be scanned again -
+ *			once the grid settles, keeping the index costs next to nothing and a
+ *			heightmap is a copy of the index.
+ * @author	Matt Drage
+ * @date	18/03/2013
+ */
+
+#ifndef SURFACEINDEX_H
+#define SURFACEINDEX_H
+
+#include <vector>
+#include "Heightmap.h"
+#include "TileSchedule.h"
+#include "ActiveTiles.h"
+
+class SurfaceIndex
+{
+	public:
+		// Constructors
+		SurfaceIndex();
+		SurfaceIndex(int width, int depth, char value);
+
+		// Index a width x depth grid for the highest cells holding value
+		void Create(int width, int depth, char value);
+
+		// Scan all columns
+		template<typename Grid>
+		void Update(Grid &grid)
+		{
+			for (int x = 0; x < m_width; x++)
+			{
+				for (int z = 0; z < m_depth; z++)
+					UpdateColumn(grid, x, z);
+			}
+		}
+
+		// Scan the columns of the tiles active in the last iteration
+		template<typename Grid>
+		void Update(Grid &grid, const TileSchedule &schedule, const ActiveTiles &active)
+		{
+			const std::vector<Tile> &tiles = schedule.GetTiles();
+			for (unsigned int t = 0; t < tiles.size(); t++)
+			{
+				if (!active.IsActive(tiles[t]))
+					continue;
+
+				for (int x = tiles[t].x0; x < tiles[t].x1; x++)
+				{
+					for (int z = tiles[t].z0; z < tiles[t].z1; z++)
+						UpdateColumn(grid, x, z);
+				}
+			}
+		}
+
+		int operator()(int x, int z) const;
+
+		// Copy heights into a heightmap (resized to match if needed)
+		void CopyTo(Heightmap &hmap) const;
+
+	private:
+		template<typename Grid>
+		void UpdateColumn(Grid &grid, int x, int z)
+		{
+			int y = grid.GetHeight() - 1;
+			while (y >= 0 && grid(x, y, z) != m_value)
+				y--;
+			m_height[x * m_depth + z] = y;
+		}
+
+		int m_width;
+		int m_depth;
+		char m_value;
+		std::vector<int> m_height;
+};
+
+#endif
@@ -0,0 +1,109 @@
+
+#include "SweepQueue.h"
+#include <algorithm>
+#include <climits>
+
+SweepQueue::SweepQueue()
+{
+	m_width = 0;
+	m_height = 0;
+	m_depth = 0;
+	m_wrapX = false;
+	m_wrapZ = false;
+	m_position = 0;
+	m_cursor = LONG_MAX;
+}
+
+SweepQueue::SweepQueue(const TileSchedule &schedule, int width, int height, int depth, bool wrapX, bool wrapZ)
+{
+	Create(schedule, width, height, depth, wrapX, wrapZ);
+}
+
+void SweepQueue::Create(const TileSchedule &schedule, int width, int height, int depth, bool wrapX, bool wrapZ)
+{
+	m_width = width;
+	m_height = height;
+	m_depth = depth;
+	m_wrapX = wrapX;
+	m_wrapZ = wrapZ;
+
+	m_rank.assign(width * depth, 0);
+	m_columns.clear();
+	const std::vector<Tile> &tiles = schedule.GetTiles();
+	for (unsigned int t = 0; t < tiles.size(); t++)
+	{
+		for (int z = tiles[t].z1 - 1; z >= tiles[t].z0; z--)
+		{
+			for (int x = tiles[t].x1 - 1; x >= tiles[t].x0; x--)
+			{
+				m_rank[x * depth + z] = m_columns.size();
+				m_columns.push_back(x * depth + z);
+			}
+		}
+	}
+
+	m_current.clear();
+	m_next.clear();
+	m_late = std::priority_queue<long, std::vector<long>, std::greater<long> >();
+	m_position = 0;
+	m_cursor = LONG_MAX;
+}
+
+void SweepQueue::Add(int x, int y, int z)
+{
+	if (m_wrapX)
+		x = ((x % m_width) + m_width) % m_width;
+	if (m_wrapZ)
+		z = ((z % m_depth) + m_depth) % m_depth;
+	if ((unsigned int)x >= (unsigned int)m_width || (unsigned int)y >= (unsigned int)m_height || (unsigned int)z >= (unsigned int)m_depth)
+		return;
+
+	// Cells are visited in increasing key order
+	long key = (long)m_rank[x * m_depth + z] * m_height + (m_height - 1 - y);
+	m_next.push_back(key);
+	if (key > m_cursor)
+		m_late.push(key);
+}
+
+int SweepQueue::Begin()
+{
+	m_current.swap(m_next);
+	m_next.clear();
+	std::sort(m_current.begin(), m_current.end());
+	m_current.erase(std::unique(m_current.begin(), m_current.end()), m_current.end());
+
+	m_position = 0;
+	m_cursor = -1;
+	return m_current.size();
+}
+
+bool SweepQueue::Next(int &x, int &y, int &z)
+{
+	for (;;)
+	{
+		// Lowest key of the cells queued before the iteration and those added during it
+		long key;
+		if (!m_late.empty() && (m_position == m_current.size() || m_late.top() < m_current[m_position]))
+		{
+			key = m_late.top();
+			m_late.pop();
+		}
+		else if (m_position < m_current.size())
+			key = m_current[m_position++];
+		else
+		{
+			m_cursor = LONG_MAX;
+			return false;
+		}
+
+		if (key <= m_cursor)
+			continue;
+
+		m_cursor = key;
+		int column = m_columns[key / m_height];
+		x = column / m_depth;
+		z = column % m_depth;
+		y = m_height - 1 - (int)(key % m_height);
+		return true;
+	}
+}
@@ -0,0 +1,64 @@
+
+/*
+ * @file	SweepQueue.h/.cpp
+ * @brief	Visits a sparse set of cells of a 3D cell grid in serial sweep order.
+ * @details	Cells are ordered as a serial sweep of the grid visits them: tile after tile
+ *			in TileSchedule order, columns of a tile from top-right to bottom-left and
+ *			each column from the top down. Update code that only needs to visit a few
+ *			cells (e.g. voids) adds them here instead of sweeping the whole grid, and
+ *			gets exactly the results of the sweep as long as every cell a rule applies
+ *			to is added before the sweep would reach it.
+ *			Begin() starts an iteration with the cells added since the last one. During
+ *			an iteration, cells added ahead of the current cell are visited in the same
+ *			iteration (as a sweep would find them) as well as the next, cells added
+ *			behind it in the next iteration only. Each cell is visited at most once per
+ *			iteration.
+ *			Positions are wrapped on wrapped axes, positions outside the grid are
+ *			ignored.
+ * @author	Matt Drage
+ * @date	25/03/2013
+ */
+
+#ifndef SWEEPQUEUE_H
+#define SWEEPQUEUE_H
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include "TileSchedule.h"
+
+class SweepQueue
+{
+	public:
+		// Constructors
+		SweepQueue();
+		SweepQueue(const TileSchedule &schedule, int width, int height, int depth, bool wrapX, bool wrapZ);
+
+		// Order the cells of a grid swept with schedule
+		void Create(const TileSchedule &schedule, int width, int height, int depth, bool wrapX, bool wrapZ);
+
+		// Queue a cell for this iteration (if ahead of the current cell) and the next
+		void Add(int x, int y, int z);
+
+		// Start an iteration, returns the number of cells queued for it
+		int Begin();
+
+		// Get the next cell of this iteration, returns false once all have been visited
+		bool Next(int &x, int &y, int &z);
+
+	private:
+		int m_width;
+		int m_height;
+		int m_depth;
+		bool m_wrapX;
+		bool m_wrapZ;
+		std::vector<int> m_rank;			// Sweep position of each x/z column
+		std::vector<int> m_columns;		// x/z column (x * depth + z) of each position
+		std::vector<long> m_current;
+		std::vector<long> m_next;
+		std::priority_queue<long, std::vector<long>, std::greater<long> > m_late;
+		unsigned int m_position;
+		long m_cursor;
+};
+
+#endif
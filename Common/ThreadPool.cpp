@@ -0,0 +1,288 @@
+
+#include "ThreadPool.h"
+#include <unistd.h>
+#include <cassert>
+#include <cstdio>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+ThreadPool::ThreadPool()
+{
+	m_numThreads = 1;
+	m_affinity = NO_AFFINITY;
+	m_threads = NULL;
+	m_workers = NULL;
+	m_task = NULL;
+	m_owners = NULL;
+	m_count = 0;
+	m_next = 0;
+	m_busy = 0;
+	m_generation = 0;
+	m_terminate = false;
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_startCondition, NULL);
+	pthread_cond_init(&m_doneCondition, NULL);
+}
+
+ThreadPool::ThreadPool(int numThreads)
+{
+	m_numThreads = 1;
+	m_affinity = NO_AFFINITY;
+	m_threads = NULL;
+	m_workers = NULL;
+	m_task = NULL;
+	m_owners = NULL;
+	m_count = 0;
+	m_next = 0;
+	m_busy = 0;
+	m_generation = 0;
+	m_terminate = false;
+	pthread_mutex_init(&m_mutex, NULL);
+	pthread_cond_init(&m_startCondition, NULL);
+	pthread_cond_init(&m_doneCondition, NULL);
+	Start(numThreads);
+}
+
+ThreadPool::~ThreadPool()
+{
+	Stop();
+	pthread_cond_destroy(&m_doneCondition);
+	pthread_cond_destroy(&m_startCondition);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void ThreadPool::Start(int numThreads)
+{
+	Stop();
+
+	if (numThreads <= 0)
+		numThreads = GetNumProcessors();
+
+	m_numThreads = numThreads;
+	m_terminate = false;
+	if (m_numThreads > 1)
+	{
+		m_threads = new pthread_t[m_numThreads - 1];
+		m_workers = new Worker[m_numThreads - 1];
+		for (int i = 0; i < m_numThreads - 1; i++)
+		{
+			m_workers[i].pool = this;
+			m_workers[i].index = i;
+			pthread_create(&m_threads[i], NULL, WorkerMain, &m_workers[i]);
+			Pin(m_threads[i], i);
+		}
+	}
+	Pin(pthread_self(), m_numThreads - 1);
+}
+
+void ThreadPool::Stop()
+{
+	if (m_threads)
+	{
+		pthread_mutex_lock(&m_mutex);
+		m_terminate = true;
+		pthread_cond_broadcast(&m_startCondition);
+		pthread_mutex_unlock(&m_mutex);
+
+		for (int i = 0; i < m_numThreads - 1; i++)
+			pthread_join(m_threads[i], NULL);
+
+		delete[] m_threads;
+		delete[] m_workers;
+		m_threads = NULL;
+		m_workers = NULL;
+	}
+	m_numThreads = 1;
+}
+
+int ThreadPool::GetNumThreads() const
+{
+	return m_numThreads;
+}
+
+void ThreadPool::SetAffinity(enum Affinity affinity)
+{
+	m_affinity = affinity;
+	m_processors.clear();
+	if (affinity == NO_AFFINITY)
+		return;
+
+#ifdef __linux__
+	// Processors this process may run on, found before any thread is pinned
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		return;
+
+	std::vector<int> processors;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if (CPU_ISSET(cpu, &allowed))
+			processors.push_back(cpu);
+	}
+
+	if (affinity == COMPACT)
+	{
+		m_processors = processors;
+		return;
+	}
+
+	// Group processors by package, then take one from each package in turn
+	std::vector<int> packageIds;
+	std::vector<std::vector<int> > packages;
+	for (unsigned int i = 0; i < processors.size(); i++)
+	{
+		char path[128];
+		sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", processors[i]);
+		int id = 0;
+		FILE *file = fopen(path, "r");
+		if (file)
+		{
+			if (fscanf(file, "%d", &id) != 1)
+				id = 0;
+			fclose(file);
+		}
+
+		unsigned int p = 0;
+		while (p < packageIds.size() && packageIds[p] != id)
+			p++;
+		if (p == packageIds.size())
+		{
+			packageIds.push_back(id);
+			packages.push_back(std::vector<int>());
+		}
+		packages[p].push_back(processors[i]);
+	}
+
+	for (unsigned int round = 0; m_processors.size() < processors.size(); round++)
+	{
+		for (unsigned int p = 0; p < packages.size(); p++)
+		{
+			if (round < packages[p].size())
+				m_processors.push_back(packages[p][round]);
+		}
+	}
+#endif
+}
+
+enum ThreadPool::Affinity ThreadPool::GetAffinity() const
+{
+	return m_affinity;
+}
+
+void ThreadPool::Pin(pthread_t thread, int index)
+{
+#ifdef __linux__
+	if (m_processors.empty())
+		return;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(m_processors[index % m_processors.size()], &set);
+	pthread_setaffinity_np(thread, sizeof(set), &set);
+#endif
+}
+
+int ThreadPool::GetNumProcessors()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (int)n : 1;
+}
+
+void ThreadPool::Run(Task &task, int count)
+{
+	Dispatch(task, count, NULL);
+}
+
+void ThreadPool::RunOwned(Task &task, const std::vector<int> &owners)
+{
+	Dispatch(task, owners.size(), &owners);
+}
+
+void ThreadPool::Dispatch(Task &task, int count, const std::vector<int> *owners)
+{
+	if (count <= 0)
+		return;
+
+	// Single thread - no need to wake anyone up
+	if (m_numThreads == 1)
+	{
+		for (int i = 0; i < count; i++)
+			task.Execute(i);
+		return;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	m_task = &task;
+	m_owners = owners;
+	m_count = count;
+	m_next = 0;
+	m_busy = m_numThreads - 1;
+	m_generation++;
+	pthread_cond_broadcast(&m_startCondition);
+	pthread_mutex_unlock(&m_mutex);
+
+	// Calling thread works too
+	ExecuteTasks(m_numThreads - 1);
+
+	// Wait for workers to finish
+	pthread_mutex_lock(&m_mutex);
+	while (m_busy > 0)
+		pthread_cond_wait(&m_doneCondition, &m_mutex);
+	m_task = NULL;
+	m_owners = NULL;
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void ThreadPool::ExecuteTasks(int thread)
+{
+	if (m_owners)
+	{
+		for (int i = 0; i < m_count; i++)
+		{
+			if ((*m_owners)[i] == thread)
+				m_task->Execute(i);
+		}
+		return;
+	}
+
+	// Claim indices one at a time until none are left
+	int index;
+	while ((index = __sync_fetch_and_add(&m_next, 1)) < m_count)
+		m_task->Execute(index);
+}
+
+void* ThreadPool::WorkerMain(void *worker)
+{
+	Worker *w = (Worker*)worker;
+	w->pool->Work(w->index);
+	return NULL;
+}
+
+void ThreadPool::Work(int index)
+{
+	int generation = 0;
+
+	while (true)
+	{
+		// Wait for next Run() call
+		pthread_mutex_lock(&m_mutex);
+		while (m_generation == generation && !m_terminate)
+			pthread_cond_wait(&m_startCondition, &m_mutex);
+		if (m_terminate)
+		{
+			pthread_mutex_unlock(&m_mutex);
+			return;
+		}
+		generation = m_generation;
+		pthread_mutex_unlock(&m_mutex);
+
+		ExecuteTasks(index);
+
+		// Signal completion
+		pthread_mutex_lock(&m_mutex);
+		if (--m_busy == 0)
+			pthread_cond_signal(&m_doneCondition);
+		pthread_mutex_unlock(&m_mutex);
+	}
+}
@@ -0,0 +1,94 @@
+
+/*
+ * @file	ThreadPool.h/.cpp
+ * @brief	Runs tasks on a fixed set of worker threads (pthreads).
+ * @details	Start(n) creates n - 1 worker threads; the thread that calls Run() works as the
+ *			n'th thread. Run(task, count) calls task.Execute(i) once for every index in
+ *			[0, count), spread dynamically over the threads, and returns once all have
+ *			completed. Start(0) uses one thread per online processor.
+ *			Execute() is called concurrently so tasks must only share read-only data or
+ *			data partitioned by index.
+ *			RunOwned() instead runs each index on a given thread (threads are numbered
+ *			from 0, the calling thread is the last), so that the same thread always works
+ *			on the same data - e.g. the cells it wrote first, which a NUMA system places
+ *			in the memory of that thread's processor.
+ *			SetAffinity() pins each thread to one processor when the pool starts (Linux
+ *			only): COMPACT fills the processors in order, SCATTER spreads consecutive
+ *			threads over the processor packages (sockets) first.
+ * @author	Matt Drage
+ * @date	11/02/2013
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+#include <vector>
+
+class ThreadPool
+{
+	public:
+		enum Affinity { NO_AFFINITY, COMPACT, SCATTER };
+
+		// Work run by the pool, one call per index
+		class Task
+		{
+			public:
+				virtual ~Task() {}
+				virtual void Execute(int index) = 0;
+		};
+
+		// Constructors & Destructors
+		ThreadPool();
+		ThreadPool(int numThreads);
+		virtual ~ThreadPool();
+
+		// Create worker threads (stops any existing ones)
+		void Start(int numThreads);
+		void Stop();
+		int GetNumThreads() const;
+
+		// Processors threads are pinned to (set before Start)
+		void SetAffinity(enum Affinity affinity);
+		enum Affinity GetAffinity() const;
+
+		// Execute task for indices [0, count) and wait for completion
+		void Run(Task &task, int count);
+
+		// Execute task for each index i on thread owners[i]
+		void RunOwned(Task &task, const std::vector<int> &owners);
+
+		static int GetNumProcessors();
+
+	private:
+		struct Worker
+		{
+			ThreadPool *pool;
+			int index;
+		};
+
+		static void* WorkerMain(void *worker);
+		void Dispatch(Task &task, int count, const std::vector<int> *owners);
+		void Work(int index);
+		void ExecuteTasks(int thread);
+		void Pin(pthread_t thread, int index);
+
+		int m_numThreads;
+		enum Affinity m_affinity;
+		std::vector<int> m_processors;
+		pthread_t *m_threads;
+		Worker *m_workers;
+		pthread_mutex_t m_mutex;
+		pthread_cond_t m_startCondition;
+		pthread_cond_t m_doneCondition;
+
+		Task *m_task;
+		const std::vector<int> *m_owners;
+		int m_count;
+		int m_next;
+		int m_busy;
+		int m_generation;
+		bool m_terminate;
+};
+
+#endif
@@ -0,0 +1,112 @@
+
+#include "TileSchedule.h"
+#include "MathUtils.h"
+#include <cassert>
+
+TileSchedule::TileSchedule()
+{
+	m_tilesX = 0;
+	m_tilesZ = 0;
+}
+
+TileSchedule::TileSchedule(int width, int depth, int tileSize, int reach, bool wrapX, bool wrapZ, int align)
+{
+	Create(width, depth, tileSize, reach, wrapX, wrapZ, align);
+}
+
+int TileSchedule::TileCount(int size, int tileSize, int reach, bool wrap, int align)
+{
+	// Rounding the edges down to a multiple of align keeps every tile at least this wide
+	int minimum = (Max(tileSize, 2 * reach) + align - 1) / align * align;
+	int count = size / minimum;
+	if (count < 1)
+		return 1;
+
+	// First and last tiles are neighbours when wrapping, so they need different colours
+	if (wrap && count > 1 && count % 2 == 1)
+		count--;
+
+	return count;
+}
+
+int TileSchedule::TileEdge(int index, int count, int size, int align)
+{
+	if (index == count)
+		return size;
+	return index * size / count / align * align;
+}
+
+void TileSchedule::Create(int width, int depth, int tileSize, int reach, bool wrapX, bool wrapZ, int align)
+{
+	align = Max(align, 1);
+	m_tilesX = TileCount(width, tileSize, reach, wrapX, align);
+	m_tilesZ = TileCount(depth, tileSize, reach, wrapZ, align);
+
+	for (int c = 0; c < NUM_COLOURS; c++)
+		m_tiles[c].clear();
+	m_allTiles.clear();
+	m_columnTileX.resize(width);
+	m_columnTileZ.resize(depth);
+
+	// Top-right to bottom-left, the same order as a serial sweep
+	for (int j = m_tilesZ - 1; j >= 0; j--)
+	{
+		for (int i = m_tilesX - 1; i >= 0; i--)
+		{
+			Tile tile;
+			tile.x0 = TileEdge(i, m_tilesX, width, align);
+			tile.x1 = TileEdge(i + 1, m_tilesX, width, align);
+			tile.z0 = TileEdge(j, m_tilesZ, depth, align);
+			tile.z1 = TileEdge(j + 1, m_tilesZ, depth, align);
+			tile.i = i;
+			tile.j = j;
+			m_tiles[(i % 2) + 2 * (j % 2)].push_back(tile);
+			m_allTiles.push_back(tile);
+		}
+	}
+
+	for (int i = 0; i < m_tilesX; i++)
+	{
+		for (int x = TileEdge(i, m_tilesX, width, align); x < TileEdge(i + 1, m_tilesX, width, align); x++)
+			m_columnTileX[x] = i;
+	}
+	for (int j = 0; j < m_tilesZ; j++)
+	{
+		for (int z = TileEdge(j, m_tilesZ, depth, align); z < TileEdge(j + 1, m_tilesZ, depth, align); z++)
+			m_columnTileZ[z] = j;
+	}
+}
+
+const std::vector<Tile>& TileSchedule::GetTiles(int colour) const
+{
+	assert(colour >= 0 && colour < NUM_COLOURS);
+	return m_tiles[colour];
+}
+
+const std::vector<Tile>& TileSchedule::GetTiles() const
+{
+	return m_allTiles;
+}
+
+int TileSchedule::GetNumTiles() const
+{
+	return m_tilesX * m_tilesZ;
+}
+
+int TileSchedule::GetTilesX() const
+{
+	return m_tilesX;
+}
+
+int TileSchedule::GetTilesZ() const
+{
+	return m_tilesZ;
+}
+
+const Tile& TileSchedule::GetTile(int x, int z) const
+{
+	// Tiles are stored from the last one back
+	int i = m_columnTileX[x];
+	int j = m_columnTileZ[z];
+	return m_allTiles[(m_tilesZ - 1 - j) * m_tilesX + (m_tilesX - 1 - i)];
+}
@@ -0,0 +1,69 @@
+
+/*
+ * @file	TileSchedule.h/.cpp
+ * @brief	Partitions the x/z plane of a cell grid into tiles of whole columns for
+ *			concurrent updates.
+ * @details	Tiles are coloured by the parity of their tile coordinates (four colours in 3D,
+ *			two if an axis has a single tile). Every tile is at least 2 * reach cells wide,
+ *			so a cell update that reads and writes no more than 'reach' cells away from its
+ *			column cannot touch the cells touched by another tile of the same colour. All
+ *			tiles of one colour can therefore be updated at the same time, one colour after
+ *			the other.
+ *			On wrapped axes the number of tiles is kept even so that the first and last
+ *			tiles (which are neighbours) get different colours.
+ *			For a 2D grid use a depth of 1.
+ *			With 'align' set, tile edges fall on multiples of it (except the far edges of
+ *			the grid), e.g. so that tiles hold whole columns of bricks (see
+ *			CellGrid3D::BRICKS).
+ * @author	Matt Drage
+ * @date	11/02/2013
+ */
+
+#ifndef TILESCHEDULE_H
+#define TILESCHEDULE_H
+
+#include <vector>
+
+// Columns [x0, x1) x [z0, z1), tile coordinates (i, j)
+struct Tile
+{
+	int x0, x1;
+	int z0, z1;
+	int i, j;
+};
+
+class TileSchedule
+{
+	public:
+		static const int NUM_COLOURS = 4;
+
+		// Constructors
+		TileSchedule();
+		TileSchedule(int width, int depth, int tileSize, int reach, bool wrapX, bool wrapZ, int align = 1);
+
+		// Partition a width x depth plane into tiles roughly tileSize x tileSize
+		void Create(int width, int depth, int tileSize, int reach, bool wrapX, bool wrapZ, int align = 1);
+
+		// Tiles of one colour / all tiles, in the order they should be updated when run serially
+		const std::vector<Tile>& GetTiles(int colour) const;
+		const std::vector<Tile>& GetTiles() const;
+		int GetNumTiles() const;
+		int GetTilesX() const;
+		int GetTilesZ() const;
+
+		// Tile holding column (x, z) of the grid
+		const Tile& GetTile(int x, int z) const;
+
+	private:
+		static int TileCount(int size, int tileSize, int reach, bool wrap, int align);
+		static int TileEdge(int index, int count, int size, int align);
+
+		int m_tilesX;
+		int m_tilesZ;
+		std::vector<int> m_columnTileX;
+		std::vector<int> m_columnTileZ;
+		std::vector<Tile> m_tiles[NUM_COLOURS];
+		std::vector<Tile> m_allTiles;
+};
+
+#endif
@@ -0,0 +1,66 @@
+
+#include "TimeSkew.h"
+#include "MathUtils.h"
+
+TimeSkew::TimeSkew()
+{
+	m_levels = 0;
+}
+
+TimeSkew::TimeSkew(int width, int stripWidth, int levels, int reach, bool wrapX)
+{
+	Create(width, stripWidth, levels, reach, wrapX);
+}
+
+void TimeSkew::Create(int width, int stripWidth, int levels, int reach, bool wrapX)
+{
+	m_levels = levels;
+	m_steps.clear();
+
+	int shift = 2 * Max(reach, 1);
+	int strips = Max(width / Max(stripWidth, 1), 1);
+
+	// Iteration 'level' of the strips covers [level * shift, end), on a wrapped axis
+	// ending far enough from the right edge not to touch columns still to be updated
+	// at the left edge
+	std::vector<int> start(levels), end(levels);
+	for (int level = 0; level < levels; level++)
+	{
+		end[level] = wrapX ? Max(width - level * shift, 0) : width;
+		start[level] = Min(level * shift, end[level]);
+	}
+
+	for (int s = strips - 1; s >= 0; s--)
+	{
+		int x0 = s * width / strips;
+		int x1 = (s + 1) * width / strips;
+		for (int level = 0; level < levels; level++)
+			AddStep(level, Max(x0 + level * shift, start[level]), Min(x1 + level * shift, end[level]));
+	}
+
+	// Columns at the right edge, then the left edge, one iteration after the other
+	for (int level = 1; level < levels; level++)
+	{
+		AddStep(level, end[level], width);
+		AddStep(level, 0, start[level]);
+	}
+}
+
+void TimeSkew::AddStep(int level, int x0, int x1)
+{
+	if (x0 >= x1)
+		return;
+
+	SkewStep step = { level, x0, x1 };
+	m_steps.push_back(step);
+}
+
+const std::vector<SkewStep>& TimeSkew::GetSteps() const
+{
+	return m_steps;
+}
+
+int TimeSkew::GetLevels() const
+{
+	return m_levels;
+}
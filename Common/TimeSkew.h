@@ -0,0 +1,54 @@
+
+/*
+ * @file	TimeSkew.h/.cpp
+ * @brief	Orders the column updates of several iterations of a serial sweep so that
+ *			each part of the grid is advanced through all of them while it is in cache.
+ * @details	The grid is cut along x into strips of whole columns. Strips are visited from
+ *			right to left, and each is advanced 'levels' iterations before moving on, the
+ *			columns of each further iteration shifted right by 'shift' cells. A cell update
+ *			reads and writes no more than 'reach' cells from its column, so two column
+ *			updates only interact if they are at most 2 * reach apart. With a shift of
+ *			2 * reach every column is updated after all columns it interacts with have
+ *			completed the previous iteration, and before any of them starts the next, so
+ *			each iteration is a complete sweep of the grid (in a different column order to
+ *			a plain sweep). Columns left behind by the shift at the left edge, and on a
+ *			wrapped x axis those kept back at the right edge to stay clear of the left edge,
+ *			are updated after the last strip.
+ *			Steps cover the grid once per level, in the order they must be run.
+ * @author	Matt Drage
+ * @date	25/03/2013
+ */
+
+#ifndef TIMESKEW_H
+#define TIMESKEW_H
+
+#include <vector>
+
+// Columns [x0, x1) (all z) of iteration 'level' of a block
+struct SkewStep
+{
+	int level;
+	int x0, x1;
+};
+
+class TimeSkew
+{
+	public:
+		// Constructors
+		TimeSkew();
+		TimeSkew(int width, int stripWidth, int levels, int reach, bool wrapX);
+
+		// Order 'levels' iterations of a grid 'width' columns wide
+		void Create(int width, int stripWidth, int levels, int reach, bool wrapX);
+
+		const std::vector<SkewStep>& GetSteps() const;
+		int GetLevels() const;
+
+	private:
+		void AddStep(int level, int x0, int x1);
+
+		int m_levels;
+		std::vector<SkewStep> m_steps;
+};
+
+#endif
@@ -0,0 +1,79 @@
+
+#include "VoidJumps.h"
+#include <cassert>
+
+VoidJumps::VoidJumps()
+{
+	m_radius = 0;
+	m_maxRows = 1;
+}
+
+void VoidJumps::Create(const SelectionSet<Vector3> &neighbourhood, int radius, int maxRows)
+{
+	m_radius = radius;
+	m_maxRows = maxRows < 1 ? 1 : maxRows;
+	m_jumps.assign(m_maxRows, SelectionSet<Vector3>());
+
+	// Single move probabilities on a grid of x/z offsets
+	int size = 2 * radius + 1;
+	std::vector<double> move(size * size, 0.0);
+	double total = 0;
+	for (int i = 0; i < neighbourhood.GetSetSize(); i++)
+	{
+		const Vector3 &offset = neighbourhood.GetValue(i);
+		int dx = (int)offset.x + radius;
+		int dz = (int)offset.z + radius;
+		assert(dx >= 0 && dx < size && dz >= 0 && dz < size && offset.y == 1);
+		move[dx * size + dz] += neighbourhood.GetProbability(i);
+		total += neighbourhood.GetProbability(i);
+	}
+	for (unsigned int i = 0; i < move.size(); i++)
+		move[i] /= total;
+
+	// Offsets after n moves - those after n - 1 moves convolved with a single move
+	std::vector<double> current(1, 1.0), next;
+	int currentSize = 1;
+	for (int n = 1; n <= m_maxRows; n++)
+	{
+		int nextSize = currentSize + size - 1;
+		next.assign(nextSize * nextSize, 0.0);
+		for (int ax = 0; ax < currentSize; ax++)
+		{
+			for (int az = 0; az < currentSize; az++)
+			{
+				double p = current[ax * currentSize + az];
+				if (p == 0)
+					continue;
+				for (int bx = 0; bx < size; bx++)
+				{
+					for (int bz = 0; bz < size; bz++)
+						next[(ax + bx) * nextSize + az + bz] += p * move[bx * size + bz];
+				}
+			}
+		}
+		current.swap(next);
+		currentSize = nextSize;
+
+		int reach = n * radius;
+		for (int x = 0; x < currentSize; x++)
+		{
+			for (int z = 0; z < currentSize; z++)
+			{
+				if (current[x * currentSize + z] > 0)
+					m_jumps[n - 1].Add(current[x * currentSize + z], Vector3(x - reach, n, z - reach));
+			}
+		}
+		m_jumps[n - 1].BuildAliasTable();
+	}
+}
+
+int VoidJumps::GetMaxRows() const
+{
+	return m_maxRows;
+}
+
+Vector3 VoidJumps::Select(int rows)
+{
+	assert(rows >= 1 && rows <= m_maxRows);
+	return m_jumps[rows - 1].RouletteSelect();
+}
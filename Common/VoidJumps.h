@@ -0,0 +1,72 @@
+
+/*
+ * @file	VoidJumps.h/.cpp
+ * @brief	Moves a void several rows at once through solid ground.
+ * @details	Each move of a void rises one row, with a horizontal offset from a selection
+ *			set. While every cell the void could reach is the same (e.g. earth), moving
+ *			it n rows in one step gives the same result as n single moves: the cells
+ *			passed through are left unchanged and only the void's final position
+ *			matters. The distribution of that position is the single move distribution
+ *			convolved with itself n times, which is precomputed for each n up to a
+ *			maximum, so a jump of any length takes one selection.
+ *			ClearRows() finds how far a void can jump - the number of rows above it in
+ *			which every cell within reach is the given value. Row n is checked within
+ *			n * radius cells horizontally, and is only checked once rows 1 to n - 1 are
+ *			clear, so a void next to other cell types costs a few reads.
+ *			The selection set must only hold offsets of one row up (as generated by
+ *			GenerateSelectionSet()).
+ * @author	Matt Drage
+ * @date	25/03/2013
+ */
+
+#ifndef VOIDJUMPS_H
+#define VOIDJUMPS_H
+
+#include <vector>
+#include "SelectionSet.h"
+#include "Vector3.h"
+
+class VoidJumps
+{
+	public:
+		// Constructors
+		VoidJumps();
+
+		// Precompute jumps of up to maxRows moves of neighbourhood (offsets at most
+		// radius cells from the column)
+		void Create(const SelectionSet<Vector3> &neighbourhood, int radius, int maxRows);
+		int GetMaxRows() const;
+
+		// Offset of a void after 'rows' moves (1 to GetMaxRows())
+		Vector3 Select(int rows);
+
+		// Rows above (x, y, z) a void may jump, at most GetMaxRows() and never past the top
+		// of the grid
+		template<typename Grid>
+		int ClearRows(Grid &grid, int x, int y, int z, char value) const
+		{
+			int rows = 0;
+			while (rows < m_maxRows && y + rows + 1 < grid.GetHeight())
+			{
+				int cy = y + rows + 1;
+				int reach = (rows + 1) * m_radius;
+				for (int cx = x - reach; cx <= x + reach; cx++)
+				{
+					for (int cz = z - reach; cz <= z + reach; cz++)
+					{
+						if (grid(cx, cy, cz) != value)
+							return rows;
+					}
+				}
+				rows++;
+			}
+			return rows;
+		}
+
+	private:
+		int m_radius;
+		int m_maxRows;
+		std::vector<SelectionSet<Vector3> > m_jumps;	// Offsets after n moves at n - 1
+};
+
+#endif
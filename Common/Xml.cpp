@@ -82,3 +82,30 @@ Xml::Element* Xml::Element::GetSubElement(const std::string &name)
 	}
 	return NULL;
 }
+
+Xml::Element* Xml::Element::Find(const std::string &path)
+{
+	Element *e = this;
+	std::string xPath = path;
+	
+	// Traverse path
+	while (e != NULL)
+	{
+		// Get name of next element in path
+		std::string name;
+		int slash = xPath.find('/');
+		if (slash != std::string::npos)
+			name = xPath.substr(0, slash);
+		else 
+			name = xPath;
+		
+		// Next element
+		e = e->GetSubElement(name);
+		
+		if (slash == std::string::npos)
+			break;
+		
+		xPath = xPath.substr(slash + 1);
+	}
+	return e;
+}
@@ -28,32 +28,14 @@ class Xml
 
 			Element* GetSubElement(const std::string &name);
 			
+			// Get the element at a path relative to this element (NULL if there is none)
+			Element* Find(const std::string &path);
+			
 			// Get a value from a path relative to this element
 			template<typename T>
 			T Get(const std::string &path)
 			{
-				Element *e = this;
-				std::string xPath = path;
-				
-				// Traverse path
-				while (true)
-				{
-					// Get name of next element in path
-					std::string name;
-					int slash = xPath.find('/');
-					if (slash != std::string::npos)
-						name = xPath.substr(0, slash);
-					else 
-						name = xPath;
-					
-					// Next element
-					e = e->GetSubElement(name);
-					
-					if (slash == std::string::npos)
-						break;
-					
-					xPath = xPath.substr(slash + 1);
-				}
+				Element *e = Find(path);
 				
 				// Strange hack required to return whole string if string has spaces
 				// (otherwise only the first word would be returned)
@@ -68,6 +50,15 @@ class Xml
 				ss >> result;
 				return result;
 			}
+			
+			// Get a value, or defaultValue if the path does not exist
+			template<typename T>
+			T Get(const std::string &path, T defaultValue)
+			{
+				if (Find(path) == NULL)
+					return defaultValue;
+				return Get<T>(path);
+			}
 		};
 
 		typedef struct Element Element;
@@ -90,6 +81,12 @@ class Xml
 		{
 			return root.Get<T>(path);
 		}
+		
+		template<typename T>
+		T Get(const std::string &path, T defaultValue)
+		{
+			return root.Get<T>(path, defaultValue);
+		}
 
 	private:
 		void ReadSubElements(Element *current, std::ifstream &file);
@@ -8,128 +8,66 @@
 #include "../Common/Input.h"
 #include "../Common/Png.h"
 #include "../Common/Xml.h"
+#include "../Common/TileSchedule.h"
+#include "../Common/ActiveTiles.h"
+#include "../Common/CellRules.h"
+#include "../Common/CellPlane.h"
 
 using std::string;
 using std::map;
 
-const char VOID = 0;
-const char STATIC_VOID = 1;
-const char COAL = 2;
-const char DRILL = 3;
-const char AIR = 4;
-const char CUSTOM = 5;
+const char VOID = 'v';
+const char STATIC_VOID = 's';
+const char COAL = 'c';
+const char DRILL = 'd';
+const char AIR = 'a';
+const char CUSTOM = 'A';	// First of the custom cell types, in the order of the config file
 
 const int SS_SIZE = 5;
 
-struct CellType
-{
-	Colour colour;
-	float killBubble;
-	SelectionSet<int> selectionSet;
-	
-	CellType() { killBubble = 0; }
-	CellType(const Colour &c) 
-	{ 
-		colour = c; 
-		killBubble = 0; 
-		GenerateSelectionSet(selectionSet, 0.0, 3.0, -SS_SIZE, SS_SIZE);
-	}
-};
-typedef struct CellType CellType;
-
-typedef map<char, CellType> CellTypeMap;
-CellTypeMap cellType;
+// Colour of every cell value, indexed directly by value
+Colour colour[256];
 
 CellGrid2D grid;
+CellRules rules;
+KillBubble killBubble;
+TileSchedule schedule;
+ActiveTiles active;
+bool settled;
+unsigned int iteration;
 
-void UpdateDrill(int x, int y)
+void Update(double deltaTime)
 {
-	// Spawn void cell
-	grid(x, y) = VOID;
-	
-	// Move drill onto adjacent coal cell
-	// Order of movement is down, right, up, left
-	if (grid(x, y - 1) == COAL)
-		grid(x, y - 1) = DRILL;
-	else if (grid(x + 1, y) == COAL)
-		grid(x + 1, y) = DRILL;
-	else if (grid(x, y + 1) == COAL)
-		grid(x, y + 1) = DRILL;
-	else if (grid(x - 1, y) == COAL)
-		grid(x - 1, y) = DRILL;
-}
+	if (Key.escape)
+		exit(0);
 
-void UpdateVoid(int x, int y)
-{
-	// Use probability distribution for cell type about to move onto
-	char type;
-	int offset = 0;
-	do
-	{
-		type = grid(x + offset, y + 1);
-		offset = cellType[type].selectionSet.RouletteSelect();
-	} 
-	while (grid(x + offset, y + 1) != type);
+	// Update active tiles only (see ActiveTiles), a tile is live if it holds a drill or
+	// a void that may move, or if cells were compressed. The rules are those of the 3D
+	// drivers, applied to the grid as the plane z = 0.
+	if (settled)
+		return;
 	
-	if (type == AIR || type >= CUSTOM)
+	// No active tile means no rule applied in the last iteration, and since a drill keeps
+	// its tile live, no drill remains - nothing will move again
+	if (active.Advance() == 0)
 	{
-		// chance of converting to static void
-		if (Random::Float() < cellType[type].killBubble)
-			grid(x, y) = STATIC_VOID;
-		else 
-		{
-			// Swap value with neighbour chosen using selection set
-			grid(x, y) = grid(x + offset, y + 1);
-			grid(x + offset, y + 1) = VOID;
-		}
+		settled = true;
+		std::cout << "Settled after iteration " << iteration << "\n";
+		return;
 	}
-}
-
-void UpdateCustom(int x, int y)
-{
-	// Compress down if air or static void is underneath - prevent floating blocks
-	if (grid(x, y - 1) == AIR || grid(x, y - 1) == STATIC_VOID)
+	iteration++;
+	CellPlane<CellGrid2D> plane(grid);
+	const std::vector<Tile> &tiles = schedule.GetTiles();
+	for (unsigned int t = 0; t < tiles.size(); t++)
 	{
-		// At least one of the cells to the left, right, lower-left or lower-right
-		// must also be air/static void for compression to occur
-		if (grid(x - 1, y - 1) == AIR || grid(x + 1, y - 1) == AIR
-			|| grid(x - 1, y) == AIR || grid(x + 1, y) == AIR
-			|| grid(x - 1, y - 1) == STATIC_VOID || grid(x + 1, y - 1) == STATIC_VOID
-			|| grid(x - 1, y) == STATIC_VOID || grid(x + 1, y) == STATIC_VOID)
-		{
-			// Compress all cells above downward
-			for (int i = y - 1; i < grid.GetHeight(); i++)
-				grid(x, i) = grid(x, i + 1);
-		}
-	}
-}
+		if (!active.IsActive(tiles[t]))
+			continue;
 
-void Update(double deltaTime)
-{
-	if (Key.escape)
-		exit(0);
-	
-	for (int x = grid.GetWidth() - 1; x >= 0 ; x--)
-	{
-		for (int y = grid.GetHeight() - 1; y >= 0; y--)
-		{
-			switch (grid(x, y))
-			{
-				case DRILL:	
-					UpdateDrill(x, y);	
-					break;
-				case VOID:	
-					UpdateVoid(x, y);	
-					break;
-				case AIR:
-				case STATIC_VOID:
-				case COAL:
-					break;
-				default:	
-					UpdateCustom(x, y);	
-					break;
-			}
-		}
+		bool live = false;
+		for (int x = tiles[t].x1 - 1; x >= tiles[t].x0; x--)
+			live |= rules.UpdateColumn(plane, x, 0, iteration);
+		if (live)
+			active.MarkLive(tiles[t]);
 	}
 }
 
@@ -139,7 +77,7 @@ void Render()
 	{
 		for (int y = 0; y < grid.GetHeight(); y++)
 		{
-			RenderRectangle(x, y, 1, 1, cellType[grid(x, y)].colour);
+			RenderRectangle(x, y, 1, 1, colour[(unsigned char)grid(x, y)]);
 		}
 	}
 }
@@ -149,44 +87,53 @@ int main(int argc, char **argv)
 	// Load config file
 	string configFile = (argc == 2) ? argv[1] : "Config.xml";
 	Xml xml(configFile);
-	
+
 	// Setup default cell types
 	map<Colour, char> cvMap;
-	CellType cct(xml.Get<Colour>("Coal"));
-	cellType[COAL] = cct;
-	cvMap[cct.colour] = COAL;
-	CellType dct(xml.Get<Colour>("Drill"));
-	cellType[DRILL] = dct;
-	cvMap[dct.colour] = DRILL;
-	CellType act(xml.Get<Colour>("Air"));
-	cellType[AIR] = act;
-	cvMap[act.colour] = AIR;
-	CellType vct(Colour::White());
-	cellType[VOID] = vct;
-	CellType svct(Colour::White());
-	cellType[STATIC_VOID] = svct;
+	colour[(unsigned char)COAL] = xml.Get<Colour>("Coal");
+	cvMap[colour[(unsigned char)COAL]] = COAL;
+	colour[(unsigned char)DRILL] = xml.Get<Colour>("Drill");
+	cvMap[colour[(unsigned char)DRILL]] = DRILL;
+	colour[(unsigned char)AIR] = xml.Get<Colour>("Air");
+	cvMap[colour[(unsigned char)AIR]] = AIR;
+	colour[(unsigned char)VOID] = Colour::White();
+	colour[(unsigned char)STATIC_VOID] = Colour::White();
+
+	// Each cell type has its own distribution of the cells in the row above a void moves
+	// onto, and chance of killing it (see CellRules::SetNeighbourhood()). Air has its
+	// own too, so the defaults never apply.
+	CellPlane<CellGrid2D> plane(grid);
+	SelectionSet<Vector3> selection;
+	GenerateSelectionSet(selection, 0.0, 3.0, -SS_SIZE, SS_SIZE);
+	killBubble.Create(0, KillBubble::BERNOULLI, 0, 0, 0, false, false);
+	rules.SetNeighbourhood(plane, selection);
+	rules.SetKillBubble(&killBubble);
+	rules.SetNeighbourhood(plane, selection, AIR, 0);
 	
-	// Load custom cell types and generate colour-value map
+	// Load custom cell types and generate colour-value map. Custom types are passable
+	// and collapse into air and static voids, as earth does in the 3D drivers.
+	string customs;
 	char value = CUSTOM;
 	Xml::ElementListType elements = xml.root.subElements;
 	for (Xml::ElementListType::iterator i = elements.begin(); i != elements.end(); i++)
 	{
 		if ((*i)->name == "CellType")
 		{
-			CellType ct;
-			ct.colour = (*i)->Get<Colour>("Colour");
-			ct.killBubble = (*i)->Get<float>("KillBubble");
+			colour[(unsigned char)value] = (*i)->Get<Colour>("Colour");
+			cvMap[colour[(unsigned char)value]] = value;
+			customs += string(1, value) + " ";
+			
 			float mean = (*i)->Get<float>("ProbabiltyDistribution/Mean");
 			float variance = (*i)->Get<float>("ProbabiltyDistribution/Variance");
-			GenerateSelectionSet(ct.selectionSet, mean, variance, -SS_SIZE, SS_SIZE);
-			cellType[value] = ct;
-			
-			cvMap[ct.colour] = value;
+			selection.Clear();
+			GenerateSelectionSet(selection, mean, variance, -SS_SIZE, SS_SIZE);
+			rules.SetNeighbourhood(plane, selection, value, (*i)->Get<float>("KillBubble"));
 			value++;
 		}
 	}
+	rules.Create(VOID, STATIC_VOID, DRILL, customs + "air", "coal", customs, "air static", "air");
 	
-	// Init cell grid
+	// Init cell grid, colours of no cell type are voids
 	Png png(xml.Get<string>("CellMap"));
 	int width = png.GetWidth();
 	int height = png.GetHeight();
@@ -194,18 +141,26 @@ int main(int argc, char **argv)
 	for (int x = 0; x < width; x++)
 	{
 		for (int y = 0; y < height; y++)
-			grid(x, y) = cvMap[png.GetPixel(x, y)];
+		{
+			map<Colour, char>::iterator i = cvMap.find(png.GetPixel(x, y));
+			grid(x, y) = (i != cvMap.end()) ? i->second : VOID;
+		}
 	}
-	
+
 	// Init random selection
 	Random::SetSeed();
-	
-	// Cell grid bound modes
-	grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::TOP);
-	grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::BOTTOM);
-	grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::LEFT);
-	grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::RIGHT);
-	
+
+	// Cell grid bound modes - collapsing columns draw air in at the top
+	grid.SetBoundMode(CellGrid2D::BORDER, CellGrid2D::TOP, AIR);
+	grid.SetBoundMode(CellGrid2D::BORDER, CellGrid2D::BOTTOM, 0);
+	grid.SetBoundMode(CellGrid2D::BORDER, CellGrid2D::LEFT, 0);
+	grid.SetBoundMode(CellGrid2D::BORDER, CellGrid2D::RIGHT, 0);
+
+	// Split grid into tiles of columns, only tiles where rules apply are updated
+	schedule.Create(width, 1, 16, rules.GetReach(SS_SIZE), false, false);
+	active.Create(schedule, false, false);
+	settled = false;
+
 	// Setup OpenGL window
 	InitWindow(width, height, "Cellular Automata Simulation", Colour::White());
 	RunApp(60, Update, Render);
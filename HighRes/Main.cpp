@@ -1,105 +1,429 @@
 
 #include "../Common/CellGrid3D.h"
+#include "../Common/PackedCellGrid3D.h"
 #include "../Common/SelectionSet.h"
+#include "../Common/Random.h"
 #include "../Common/Timer.h"
 #include "../Common/Heightmap.h"
 #include "../Common/Xml.h"
 #include "../Common/Obj.h"
+#include "../Common/MathUtils.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/TileSchedule.h"
+#include "../Common/ActiveTiles.h"
+#include "../Common/TimeSkew.h"
+#include "../Common/SweepQueue.h"
+#include "../Common/KillBubble.h"
+#include "../Common/VoidJumps.h"
+#include "../Common/CellRules.h"
+#include "../Common/MiningPlan.h"
+#include "../Common/Checkpoint.h"
+#include "../Common/CmdArgs.h"
 #include <iostream>
+#include <ctime>
 
+// Surface of the output model (cell states and rules are set in the config, see CellRules)
 const char EARTH = 'e';
-const char AIR  = 'a';
-const char COAL = 'c';
-const char DRILL = 'd';
-const char VOID  = 'v';
-const char STATIC_VOID = 's';
 
-void Iterate(CellGrid3D &grid, SelectionSet<Vector3> neighbourhood, float killBubble)
+// Update the columns of a tile from top-right to bottom-left. Columns far enough from the
+// x/z borders for their whole neighbourhood to be inside the grid skip bounds logic entirely.
+// Returns true if any column is live.
+template<typename Edge, typename Interior>
+bool UpdateTile(Edge &edge, Interior &interior, const Tile &tile, CellRules &rules, unsigned int iteration, int reach)
 {
-	for (int z = grid.GetDepth() - 1; z >= 0; z--)
+	bool live = false;
+	for (int z = tile.z1 - 1; z >= tile.z0; z--)
 	{
-		for (int x = grid.GetWidth() - 1; x >= 0 ; x--)
+		bool zInside = z >= reach && z < edge.GetDepth() - reach;
+		for (int x = tile.x1 - 1; x >= tile.x0; x--)
 		{
-			for (int y = grid.GetHeight() - 1; y >= 0; y--)
+			if (zInside && x >= reach && x < edge.GetWidth() - reach)
+				live |= rules.UpdateColumn(interior, x, z, iteration);
+			else
+				live |= rules.UpdateColumn(edge, x, z, iteration);
+		}
+	}
+	return live;
+}
+
+// Pinned threads each own a band of columns along x, band i starting at column
+// BandStart(i). A tile belongs to the band holding its middle.
+int BandStart(int band, int numBands, int width)
+{
+	return (long)band * width / numBands;
+}
+
+int TileOwner(const Tile &tile, int numBands, int width)
+{
+	return Min((int)((long)(tile.x0 + tile.x1) / 2 * numBands / width), numBands - 1);
+}
+
+// Update the active tiles of one colour - one tile per task
+template<typename Edge, typename Interior>
+class UpdateTiles : public ThreadPool::Task
+{
+	public:
+		UpdateTiles(Edge &edge, Interior &interior, const std::vector<Tile> &tiles, ActiveTiles &active, CellRules &rules, unsigned int iteration, int reach)
+			: m_edge(edge), m_interior(interior), m_tiles(tiles), m_active(active), m_rules(rules)
+		{
+			m_iteration = iteration;
+			m_reach = reach;
+		}
+		
+		void Execute(int index)
+		{
+			if (UpdateTile(m_edge, m_interior, m_tiles[index], m_rules, m_iteration, m_reach))
+				m_active.MarkLive(m_tiles[index]);
+		}
+	
+	private:
+		Edge &m_edge;
+		Interior &m_interior;
+		const std::vector<Tile> &m_tiles;
+		ActiveTiles &m_active;
+		CellRules &m_rules;
+		unsigned int m_iteration;
+		int m_reach;
+};
+
+// Sweep the active tiles - serially if there is no thread pool, otherwise one colour of
+// tiles at a time with the tiles of each colour updated concurrently
+struct IterateTiles
+{
+	CellRules *rules;
+	unsigned int iteration;
+	int reach;
+	const TileSchedule *schedule;
+	ActiveTiles *active;
+	ThreadPool *pool;
+	
+	template<typename Edge, typename Interior>
+	void operator()(Edge &edge, Interior &interior)
+	{
+		if (pool == NULL)
+		{
+			const std::vector<Tile> &tiles = schedule->GetTiles();
+			for (unsigned int i = 0; i < tiles.size(); i++)
+			{
+				if (active->IsActive(tiles[i]) && UpdateTile(edge, interior, tiles[i], *rules, iteration, reach))
+					active->MarkLive(tiles[i]);
+			}
+			return;
+		}
+		
+		std::vector<Tile> tiles;
+		std::vector<int> owners;
+		for (int colour = 0; colour < TileSchedule::NUM_COLOURS; colour++)
+		{
+			// Tiles of earlier colours may have activated tiles of this one
+			const std::vector<Tile> &colourTiles = schedule->GetTiles(colour);
+			tiles.clear();
+			for (unsigned int i = 0; i < colourTiles.size(); i++)
+			{
+				if (active->IsActive(colourTiles[i]))
+					tiles.push_back(colourTiles[i]);
+			}
+			
+			UpdateTiles<Edge, Interior> task(edge, interior, tiles, *active, *rules, iteration, reach);
+			if (pool->GetAffinity() == ThreadPool::NO_AFFINITY)
+			{
+				pool->Run(task, tiles.size());
+				continue;
+			}
+			
+			// Each tile on the thread whose memory holds it
+			owners.clear();
+			for (unsigned int i = 0; i < tiles.size(); i++)
+				owners.push_back(TileOwner(tiles[i], pool->GetNumThreads(), edge.GetWidth()));
+			pool->RunOwned(task, owners);
+		}
+	}
+};
+
+template<typename Grid>
+void Iterate(Grid &grid, CellRules &rules, int radius, unsigned int iteration, const TileSchedule &schedule, ActiveTiles &active, ThreadPool *pool)
+{
+	IterateTiles iterate = { &rules, iteration, rules.GetReach(radius), &schedule, &active, pool };
+	DispatchBounds(grid, iterate, iterate.reach, 1, iterate.reach);
+}
+
+// Advance the active tiles through the iterations of a time block in the order of the
+// steps of the skew, each step updating the part of every tile inside its columns.
+// Counts the columns updated.
+struct IterateSkewed
+{
+	CellRules *rules;
+	unsigned int iteration;
+	int reach;
+	const TimeSkew *skew;
+	const TileSchedule *schedule;
+	ActiveTiles *active;
+	long columns;
+	
+	template<typename Edge, typename Interior>
+	void operator()(Edge &edge, Interior &interior)
+	{
+		const std::vector<SkewStep> &steps = skew->GetSteps();
+		const std::vector<Tile> &tiles = schedule->GetTiles();
+		for (unsigned int s = 0; s < steps.size(); s++)
+		{
+			unsigned int stepIteration = iteration + steps[s].level;
+			for (unsigned int i = 0; i < tiles.size(); i++)
 			{
-				Vector3 offset, target;
+				Tile part = tiles[i];
+				part.x0 = Max(part.x0, steps[s].x0);
+				part.x1 = Min(part.x1, steps[s].x1);
+				if (part.x0 >= part.x1 || !active->IsActive(tiles[i], stepIteration))
+					continue;
 				
-				switch (grid(x, y, z))
+				columns += (part.x1 - part.x0) * (part.z1 - part.z0);
+				if (UpdateTile(edge, interior, part, *rules, stepIteration, reach))
+					active->MarkLive(tiles[i], stepIteration);
+			}
+		}
+	}
+};
+
+template<typename Grid>
+long Iterate(Grid &grid, CellRules &rules, int radius, unsigned int iteration, const TimeSkew &skew, const TileSchedule &schedule, ActiveTiles &active)
+{
+	IterateSkewed iterate = { &rules, iteration, rules.GetReach(radius), &skew, &schedule, &active, 0 };
+	DispatchBounds(grid, iterate, iterate.reach, 1, iterate.reach);
+	return iterate.columns;
+}
+
+// Run one phase of a synchronous update on a list of tiles - one tile per task
+template<typename Edge, typename Interior>
+class UpdatePhase : public ThreadPool::Task
+{
+	public:
+		UpdatePhase(Edge &edge, Interior &interior, const std::vector<Tile> &tiles, ActiveTiles &active, CellRules &rules, unsigned int iteration, int reach, CellRules::Phase phase)
+			: m_edge(edge), m_interior(interior), m_tiles(tiles), m_active(active), m_rules(rules)
+		{
+			m_iteration = iteration;
+			m_reach = reach;
+			m_phase = phase;
+		}
+		
+		// A row of the tile at a time from the top, in storage order for the ROWS layout
+		void Execute(int index)
+		{
+			const Tile &tile = m_tiles[index];
+			int z0 = Max(tile.z0, m_reach);
+			int z1 = Min(tile.z1, m_edge.GetDepth() - m_reach);
+			bool live = false;
+			for (int y = m_edge.GetHeight() - 1; y >= 0; y--)
+			{
+				for (int x = tile.x0; x < tile.x1; x++)
 				{
-					case VOID:			
-						offset = neighbourhood.RouletteSelect();
-						target = Vector3(x, y, z) + offset;
-						if (grid(target) == EARTH || grid(target) == AIR)
-						{
-							if (Random::Float() < killBubble)
-								grid(x, y, z) = STATIC_VOID;
-							else 
-							{
-								grid(x, y, z) = grid(target);
-								grid(target) = VOID;
-							}
-						}
-						break;
-						
-					case DRILL:
-						grid(x, y, z) = VOID;
-						if (grid(x, y, z + 1) == COAL)
-							grid(x, y, z + 1) = DRILL;
-						else if (grid(x, y, z - 1) == COAL)
-							grid(x, y, z - 1) = DRILL;
-						else if (grid(x + 1, y, z) == COAL)
-							grid(x + 1, y, z) = DRILL;
-						else if (grid(x - 1, y, z) == COAL)
-							grid(x - 1, y, z) = DRILL;
-						break;
-						
-					case EARTH:
-						if (grid(x, y - 1 , z) == AIR || grid(x, y - 1, z) == STATIC_VOID)
-						{
-							if (grid(x - 1, y - 1, z) == AIR 
-							 || grid(x + 1, y - 1, z) == AIR
-							 || grid(x, y - 1, z - 1) == AIR 
-							 || grid(x, y - 1, z + 1) == AIR
-							 || grid(x - 1, y, z) == AIR 
-							 || grid(x + 1, y, z) == AIR
-							 || grid(x, y, z - 1) == AIR 
-							 || grid(x, y, z + 1) == AIR
-							 || grid(x - 1, y - 1, z) == STATIC_VOID 
-							 || grid(x + 1, y - 1, z) == STATIC_VOID
-							 || grid(x, y - 1, z - 1) == STATIC_VOID 
-							 || grid(x, y - 1, z + 1) == STATIC_VOID
-							 || grid(x - 1, y, z) == STATIC_VOID 
-							 || grid(x + 1, y, z) == STATIC_VOID
-							 || grid(x, y, z - 1) == STATIC_VOID 
-							 || grid(x, y, z + 1) == STATIC_VOID)
-							{
-								for (int i = y - 1; i < grid.GetHeight(); i++)
-									grid(x, i, z) = grid(x, i + 1, z);
-							}
-						}
-						break;
+					if (x < m_reach || x >= m_edge.GetWidth() - m_reach || z0 >= z1)
+					{
+						for (int z = tile.z0; z < tile.z1; z++)
+							live |= m_rules.UpdateSynchronous(m_edge, x, y, z, m_iteration, m_phase);
+						continue;
+					}
+					
+					for (int z = tile.z0; z < z0; z++)
+						live |= m_rules.UpdateSynchronous(m_edge, x, y, z, m_iteration, m_phase);
+					for (int z = z0; z < z1; z++)
+						live |= m_rules.UpdateSynchronous(m_interior, x, y, z, m_iteration, m_phase);
+					for (int z = z1; z < tile.z1; z++)
+						live |= m_rules.UpdateSynchronous(m_edge, x, y, z, m_iteration, m_phase);
 				}
 			}
+			if (live)
+				m_active.MarkLive(tile);
 		}
+	
+	private:
+		Edge &m_edge;
+		Interior &m_interior;
+		const std::vector<Tile> &m_tiles;
+		ActiveTiles &m_active;
+		CellRules &m_rules;
+		unsigned int m_iteration;
+		int m_reach;
+		CellRules::Phase m_phase;
+};
+
+// Synchronous engine - the active tiles run each phase of the update before any starts
+// the next. Updates within a phase never conflict, so with a thread pool every active
+// tile of a phase is updated at once, and the result depends neither on the number of
+// threads nor on the tile size.
+struct IterateSynchronous
+{
+	CellRules *rules;
+	unsigned int iteration;
+	int reach;
+	const std::vector<Tile> *tiles;
+	ActiveTiles *active;
+	ThreadPool *pool;
+	
+	template<typename Edge, typename Interior>
+	void operator()(Edge &edge, Interior &interior)
+	{
+		static const CellRules::Phase phases[3] = { CellRules::PROPOSE, CellRules::RESOLVE, CellRules::SETTLE };
+		for (int p = 0; p < 3; p++)
+		{
+			UpdatePhase<Edge, Interior> task(edge, interior, *tiles, *active, *rules, iteration, reach, phases[p]);
+			if (pool != NULL)
+				pool->Run(task, tiles->size());
+			else
+			{
+				for (unsigned int i = 0; i < tiles->size(); i++)
+					task.Execute(i);
+			}
+		}
+	}
+};
+
+// Synchronous update of the active tiles, reading the cells as they were at the start of
+// the iteration from the grid's second buffer (a claim is checked against the claims of
+// voids up to two radii away). Returns false if the grid cannot be updated synchronously.
+bool Iterate(CellGrid3D &grid, CellRules &rules, int radius, unsigned int iteration, const TileSchedule &schedule, ActiveTiles &active, ThreadPool *pool, std::vector<Tile> &tiles)
+{
+	// The tiles are fixed for all phases - tiles activated by the update wait for the
+	// next iteration
+	const std::vector<Tile> &allTiles = schedule.GetTiles();
+	tiles.clear();
+	for (unsigned int i = 0; i < allTiles.size(); i++)
+	{
+		if (active.IsActive(allTiles[i]))
+			tiles.push_back(allTiles[i]);
 	}
+	
+	grid.ResetHalo();
+	grid.Snapshot();
+	IterateSynchronous iterate = { &rules, iteration, Max(2 * radius, 1), &tiles, &active, pool };
+	DispatchBounds(grid, iterate, iterate.reach, 1, iterate.reach);
+	return true;
 }
 
-void SaveMesh(CellGrid3D &grid, float smoothing, const std::string outputFile)
+// Packed grids cannot hold the claims of a synchronous update
+bool Iterate(PackedCellGrid3D &grid, CellRules &rules, int radius, unsigned int iteration, const TileSchedule &schedule, ActiveTiles &active, ThreadPool *pool, std::vector<Tile> &tiles)
+{
+	std::cerr << "The synchronous engine is not supported for packed grids\n";
+	return false;
+}
+
+// Queue the cells that may have become particles - a changed cell and the cell above it
+struct ParticleObserver
+{
+	SweepQueue *queue;
+	int height;
+	
+	void Changed(int x, int y, int z)
+	{
+		queue->Add(x, y, z);
+		queue->Add(x, y + 1, z);
+	}
+	
+	void Shifted(int x, int y, int z)
+	{
+		for (int i = y - 1; i < height; i++)
+			queue->Add(x, i, z);
+	}
+};
+typedef struct ParticleObserver ParticleObserver;
+
+// Update only the particles, in the order the serial sweep would reach them. Every cell
+// a rule applies to is queued before the sweep position gets to it, so the results are
+// exactly those of the serial sweep.
+struct IterateParticles
 {
-	// Create heightmap from cell grid
+	CellRules *rules;
+	unsigned int iteration;
+	SweepQueue *queue;
+	
+	template<typename Edge, typename Interior>
+	void operator()(Edge &edge, Interior &interior)
+	{
+		ParticleObserver observer = { queue, edge.GetHeight() };
+		int x, y, z;
+		while (queue->Next(x, y, z))
+		{
+			rules->Update(edge, x, y, z, iteration, observer);
+			if (rules->MayApply(edge, x, y, z))
+				queue->Add(x, y, z);
+		}
+	}
+};
+
+// Queue every particle of the grid - the cells a rule may apply to
+template<typename Grid>
+void FindParticles(Grid &grid, CellRules &rules, SweepQueue &queue)
+{
+	for (int x = 0; x < grid.GetWidth(); x++)
+	{
+		for (int y = 0; y < grid.GetHeight(); y++)
+		{
+			for (int z = 0; z < grid.GetDepth(); z++)
+			{
+				if (rules.MayApply(grid, x, y, z))
+					queue.Add(x, y, z);
+			}
+		}
+	}
+}
+
+// Particle engine, returns the number of particles queued for the iteration
+template<typename Grid>
+int Iterate(Grid &grid, CellRules &rules, int radius, unsigned int iteration, SweepQueue &queue)
+{
+	IterateParticles iterate = { &rules, iteration, &queue };
+	int count = queue.Begin();
+	int reach = rules.GetReach(radius);
+	DispatchBounds(grid, iterate, reach, 1, reach);
+	return count;
+}
+
+template<typename Grid>
+void SaveMesh(Grid &grid, float smoothing, const std::string outputFile)
+{
+	// Create heightmap from cell grid - a line of columns at a time, from the top down
+	// until the highest earth cell of every column is found
 	Heightmap hmap;
 	hmap.SetSize(grid.GetWidth(), grid.GetDepth());
+	std::vector<unsigned long long> earth, found;
 	for (int x = 0; x < grid.GetWidth(); x++)
 	{
-		for (int z = 0; z < grid.GetDepth(); z++)
+		int remaining = grid.GetDepth();
+		found.assign((grid.GetDepth() + 63) / 64, 0);
+		for (int y = grid.GetHeight() - 1; y >= 0 && remaining > 0; y--)
 		{
-			int y = grid.GetHeight() - 1;
-			while (grid(x, y, z) != EARTH)
-				y--;
-			
-			hmap(x, z) = y;
+			grid.Match(x, y, std::string(1, EARTH), earth);
+			for (unsigned int w = 0; w < earth.size(); w++)
+			{
+				unsigned long long top = earth[w] & ~found[w];
+				found[w] |= top;
+				while (top)
+				{
+					hmap(x, w * 64 + __builtin_ctzll(top)) = y;
+					top &= top - 1;
+					remaining--;
+				}
+			}
 		}
 	}
+	
+	// Statistics of the surface, to compare runs (e.g. of different engines)
+	double sum = 0, sumSquares = 0;
+	float lowest = hmap(0, 0), highest = hmap(0, 0);
+	for (int x = 0; x < hmap.GetWidth(); x++)
+	{
+		for (int z = 0; z < hmap.GetDepth(); z++)
+		{
+			float height = hmap(x, z);
+			sum += height;
+			sumSquares += height * height;
+			lowest = Min(lowest, height);
+			highest = Max(highest, height);
+		}
+	}
+	double count = (double)hmap.GetWidth() * hmap.GetDepth();
+	double mean = sum / count;
+	std::cout << "Surface height: mean " << mean << ", standard deviation " << sqrt(Max(sumSquares / count - mean * mean, 0.0));
+	std::cout << ", lowest " << lowest << ", highest " << highest << "\n";
 	hmap.Smooth(smoothing);
 	
 	// Convert heightmap to mesh
@@ -124,28 +448,84 @@ void SaveMesh(CellGrid3D &grid, float smoothing, const std::string outputFile)
 	obj.Save(outputFile);
 }
 
-int main(int argc, char **argv)
+// Checkpoints store a CellGrid3D, packed grids cannot be saved or resumed
+bool LoadCheckpoint(CellGrid3D &grid, unsigned int &iteration, const std::string &filename)
 {
-	using std::string;
-	
-	// Read config file
-	Xml xml;
-	xml.Load("Config.xml");
-	
-	// Setup grid
-	CellGrid3D grid;
-	Vector3 dimensions = xml.Get<Vector3>("Grid/Dimensions");
-	Vector3 resolution = xml.Get<Vector3>("Grid/Resolution");
-	grid.SetSize(dimensions * resolution);
+	return Checkpoint::Load(grid, iteration, filename);
+}
+
+bool LoadCheckpoint(PackedCellGrid3D &grid, unsigned int &iteration, const std::string &filename)
+{
+	std::cerr << "Checkpoints are not supported for packed grids\n";
+	return false;
+}
+
+// Returns false if the grid cannot be saved - a save that fails is reported and the run
+// continues
+bool SaveCheckpoint(Checkpoint &checkpoint, CellGrid3D &grid, unsigned int iteration, const std::string &filename)
+{
+	checkpoint.Save(grid, iteration, filename, true);
+	return true;
+}
+
+bool SaveCheckpoint(Checkpoint &checkpoint, PackedCellGrid3D &grid, unsigned int iteration, const std::string &filename)
+{
+	std::cerr << "Checkpoints are not supported for packed grids\n";
+	return false;
+}
+
+// Tiles of a bricked grid hold whole columns of bricks
+int TileAlignment(CellGrid3D &grid)
+{
+	return grid.GetLayout() == CellGrid3D::BRICKS ? CellGrid3D::BRICK_SIZE : 1;
+}
+
+int TileAlignment(PackedCellGrid3D &grid)
+{
+	return 1;
+}
+
+// Fill the default value of one band of columns per task
+template<typename Grid>
+class FillBands : public ThreadPool::Task
+{
+	public:
+		FillBands(Grid &grid, char value, int numBands) : m_grid(grid)
+		{
+			m_value = value;
+			m_numBands = numBands;
+		}
+		
+		void Execute(int index)
+		{
+			int width = m_grid.GetWidth();
+			m_grid.Fill(m_value, BandStart(index, m_numBands, width), BandStart(index + 1, m_numBands, width));
+		}
 	
-	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Top"), CellGrid3D::TOP);
-	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Bottom"), CellGrid3D::BOTTOM);
-	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Left"), CellGrid3D::LEFT);
-	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Right"), CellGrid3D::RIGHT);
-	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Front"), CellGrid3D::FRONT);
-	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Back"), CellGrid3D::BACK);
+	private:
+		Grid &m_grid;
+		char m_value;
+		int m_numBands;
+};
 
-	grid.Fill(xml.Get<char>("Grid/DefaultValue"));
+// Fill a new grid from the config. With a thread pool, each thread first writes its
+// own band of columns (see TileOwner), placing the cells in its processor's memory on
+// a NUMA system.
+template<typename Grid>
+void FillGrid(Grid &grid, Xml &xml, const Vector3 &resolution, ThreadPool *pool)
+{
+	char value = xml.Get<char>("Grid/DefaultValue");
+	if (pool == NULL)
+		grid.Fill(value);
+	else
+	{
+		std::vector<int> owners;
+		for (int i = 0; i < pool->GetNumThreads(); i++)
+			owners.push_back(i);
+		FillBands<Grid> task(grid, value, owners.size());
+		pool->RunOwned(task, owners);
+	}
+	
 	Xml::Element *e = xml.root.GetSubElement("Grid");
 	for (Xml::ElementListType::iterator i = e->subElements.begin(); i != e->subElements.end(); i++)
 	{
@@ -157,32 +537,251 @@ int main(int argc, char **argv)
 			grid.Fill(position * resolution, size * resolution, value);
 		}
 	}
+}
+
+// Setup the grid from the config file (or a checkpoint) and run the simulation
+template<typename Grid>
+int Run(Grid &grid, Xml &xml, const std::string &resumeFile)
+{
+	using std::string;
+	
+	// Setup grid
+	grid.SetHalo(1);
+	Vector3 dimensions = xml.Get<Vector3>("Grid/Dimensions");
+	Vector3 resolution = xml.Get<Vector3>("Grid/Resolution");
+	if (!grid.SetSize(dimensions * resolution))
+	{
+		std::cerr << "Could not allocate cell grid\n";
+		return 1;
+	}
+	std::cout << "Cell grid uses " << grid.GetStorageSize() / (1024 * 1024) << " MB\n";
+	
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Top"), CellGrid3D::TOP);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Bottom"), CellGrid3D::BOTTOM);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Left"), CellGrid3D::LEFT);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Right"), CellGrid3D::RIGHT);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Front"), CellGrid3D::FRONT);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Back"), CellGrid3D::BACK);
 	
 	// Setup selection set (cell neighbourhood)
 	Vector2 mean = xml.Get<Vector2>("SelectionSet/Mean");
 	Vector2 variance = xml.Get<Vector2>("SelectionSet/Variance");
 	int radius = xml.Get<int>("SelectionSet/Radius");
-	SelectionSet<Vector3> neighbourhood;
-	GenerateSelectionSet(neighbourhood, mean, variance, radius);
-	Random::SetSeed();
+	SelectionSet<Vector3> selection;
+	GenerateSelectionSet(selection, mean, variance, radius);
+	
+	// Voids may rise several rows at once through solid earth (1 row by default)
+	VoidJumps jumps;
+	jumps.Create(selection, radius, xml.Get<int>("MaxJump", 1));
+	
+	// Simulation is reproducible for a given seed and TileSize (if the seed is omitted
+	// the current time is used)
+	Random::SetSeed(xml.Get<long>("Seed", (long)time(NULL)));
 	
 	// Load simulation parameters
 	int iterations = xml.Get<int>("Iterations");
-	float killBubble = xml.Get<float>("KillBubble");
+	float killProbability = xml.Get<float>("KillBubble");
 	float heightmapSmoothing = xml.Get<float>("HeightmapSmoothing");
+	int checkpointInterval = xml.Get<int>("Checkpoint/Interval", 0);
+	string checkpointFile = xml.Get<string>("Checkpoint/File", "HighRes.ckpt");
+	
+	// Continue a previous run - the checkpoint replaces the grid and seed from the config
+	unsigned int firstIteration = 1;
+	if (!resumeFile.empty())
+	{
+		unsigned int completed;
+		if (!LoadCheckpoint(grid, completed, resumeFile))
+			return 1;
+		firstIteration = completed + 1;
+		std::cout << "Resuming from '" << resumeFile << "' after " << completed << " iterations\n";
+	}
+	std::cout << "Random seed " << Random::GetSeed() << "\n";
+	
+	bool wrapX = grid.GetBoundMode(CellGrid3D::LEFT) == CellGrid3D::WRAP || grid.GetBoundMode(CellGrid3D::RIGHT) == CellGrid3D::WRAP;
+	bool wrapZ = grid.GetBoundMode(CellGrid3D::FRONT) == CellGrid3D::WRAP || grid.GetBoundMode(CellGrid3D::BACK) == CellGrid3D::WRAP;
+	
+	// Voids are killed by a test on every move, or count down a lifetime drawn once
+	KillBubble killBubble;
+	killBubble.Create(killProbability, xml.Get<string>("KillBubbleMode", "bernoulli"), grid.GetWidth(), grid.GetHeight(), grid.GetDepth(), wrapX, wrapZ);
+	
+	// The particle engine only visits the cells rules apply to (in the same order as the
+	// serial sweep), so its cost follows the number of voids rather than the grid size.
+	// The synchronous engine updates every cell from the state at the start of the
+	// iteration, so its updates can run in any order.
+	string engine = xml.Get<string>("Engine", "sweep");
+	bool particles = engine == "particles";
+	bool synchronous = engine == "synchronous";
+	std::vector<Tile> synchronousTiles;
+	if (synchronous && selection.GetSetSize() > CellRules::MAX_CLAIMS)
+	{
+		std::cerr << "The synchronous engine supports at most " << CellRules::MAX_CLAIMS << " neighbourhood cells\n";
+		return 1;
+	}
+	if (synchronous && jumps.GetMaxRows() > 1)
+		std::cout << "Voids do not jump in the synchronous engine, ignoring MaxJump\n";
+	
+	// Compile the rules, with neighbourhood offsets for the final grid layout (a
+	// checkpoint may change it)
+	CellRules rules;
+	rules.Load(xml);
+	rules.SetNeighbourhood(grid, selection);
+	rules.SetKillBubble(&killBubble);
+	rules.SetJumps(synchronous ? NULL : &jumps);
+	Checkpoint checkpoint;
+	
+	// An iteration that leaves the grid settled (see CellRules::IsSettled()) ends the run
+	// once the faces have stopped - the rest could only move voids through the air
+	bool stopWhenSettled = xml.Get<int>("StopWhenSettled", 1) != 0;
+	rules.SetSettling(stopWhenSettled);
+	
+	// Split grid into tiles of columns - only tiles where rules apply are updated, and
+	// in parallel mode tiles are updated concurrently
+	int tileSize = xml.Get<int>("TileSize", 32);
+	int reach = rules.GetReach(radius);
+	TileSchedule schedule(grid.GetWidth(), grid.GetDepth(), tileSize, reach, wrapX, wrapZ, TileAlignment(grid));
+	ActiveTiles active(schedule, wrapX, wrapZ);
+	long activeTotal = 0;
+	
+	// Panels mined by faces advancing on a schedule, instead of drill cells
+	MiningPlan plan;
+	plan.Load(xml, resolution);
+	unsigned int lastMined = plan.GetLastIteration();
+	if (plan.GetNumPanels() > 0)
+		std::cout << "Mining " << plan.GetNumPanels() << " panels, the last face stops after iteration " << lastMined << "\n";
+	
+	ThreadPool pool;
+	bool parallel = xml.root.Find("Threads") != NULL;
+	if (parallel && particles)
+	{
+		std::cout << "The particle engine runs serially, ignoring Threads\n";
+		parallel = false;
+	}
+	if (parallel)
+	{
+		// Pinned threads each update the tiles of their own band of columns
+		string affinity = xml.Get<string>("Affinity", "none");
+		if (affinity == "compact")
+			pool.SetAffinity(ThreadPool::COMPACT);
+		else if (affinity == "scatter")
+			pool.SetAffinity(ThreadPool::SCATTER);
+		pool.Start(xml.Get<int>("Threads"));
+		std::cout << "Using " << pool.GetNumThreads() << " threads, " << schedule.GetNumTiles() << " tiles\n";
+	}
+	
+	// A new grid is filled once the threads are running, so that each band of
+	// columns is first written by the thread that updates it
+	if (resumeFile.empty())
+		FillGrid(grid, xml, resolution, parallel ? &pool : NULL);
+	
+	SweepQueue queue;
+	long particleTotal = 0;
+	if (particles)
+	{
+		queue.Create(schedule, grid.GetWidth(), grid.GetHeight(), grid.GetDepth(), wrapX, wrapZ);
+		FindParticles(grid, rules, queue);
+	}
+	
+	// A serial sweep may advance each strip of TileSize columns through several
+	// iterations while it is in cache (see TimeSkew)
+	int timeBlock = Max(xml.Get<int>("TimeBlock", 1), 1);
+	if (timeBlock > 1 && (engine != "sweep" || parallel))
+	{
+		std::cout << "Time blocking only applies to the serial sweep, ignoring TimeBlock\n";
+		timeBlock = 1;
+	}
+	if (timeBlock > 1 && plan.GetNumPanels() > 0)
+	{
+		std::cout << "Time blocking does not support a MiningPlan, ignoring TimeBlock\n";
+		timeBlock = 1;
+	}
+	TimeSkew skew;
+	int blockEnd = 0;
+	long columnTotal = 0;
+	if (timeBlock > 1)
+		active.ActivateAll(firstIteration);
+	
+	int lastIteration = iterations;
 	
 	Timer timer;
 	timer.Start();
 	
 	// Run simulation
 	std::cout << "Running simulation...\n";
-	for (int i = 1; i <= iterations; i++)
+	for (int i = firstIteration; i <= iterations; i++)
 	{
 		if (i % (iterations / 10) == 0) 
 			std::cout << (10 * (i / ((iterations) / 10))) << "%\n";
+		
+		// Faces advance before the iteration's updates, which see the new voids
+		if ((unsigned int)i <= lastMined)
+		{
+			if (particles)
+			{
+				ParticleObserver observer = { &queue, grid.GetHeight() };
+				plan.Advance(grid, rules, i, observer);
+			}
+			else
+			{
+				TileObserver observer = { &schedule, &active };
+				plan.Advance(grid, rules, i, observer);
+			}
+		}
 			
-		Iterate(grid, neighbourhood, killBubble);
+		bool settled = false;
+		rules.ResetSettled();
+		if (particles)
+		{
+			particleTotal += Iterate(grid, rules, radius, i, queue);
+			settled = rules.IsSettled();
+		}
+		else if (timeBlock > 1)
+		{
+			// A block runs all of its iterations at once, ending on checkpoints, and has
+			// settled if none of them unsettled the grid
+			if (i > blockEnd)
+			{
+				int levels = Min(timeBlock, iterations - i + 1);
+				if (checkpointInterval > 0)
+					levels = Min(levels, checkpointInterval - (i - 1) % checkpointInterval);
+				if (levels != skew.GetLevels())
+					skew.Create(grid.GetWidth(), tileSize, levels, reach, wrapX);
+				columnTotal += Iterate(grid, rules, radius, i, skew, schedule, active);
+				blockEnd = i + levels - 1;
+				settled = rules.IsSettled();
+			}
+		}
+		else
+		{
+			activeTotal += active.Advance();
+			if (synchronous)
+			{
+				if (!Iterate(grid, rules, radius, i, schedule, active, parallel ? &pool : NULL, synchronousTiles))
+					return 1;
+			}
+			else
+				Iterate(grid, rules, radius, i, schedule, active, parallel ? &pool : NULL);
+			settled = rules.IsSettled();
+		}
+		
+		if (settled && (unsigned int)i > lastMined)
+		{
+			lastIteration = Max(i, blockEnd);
+			std::cout << "Settled after iteration " << i - 1 << " of " << iterations << ", stopping\n";
+			break;
+		}
+		
+		// Saved in the background while the simulation continues
+		if (checkpointInterval > 0 && i % checkpointInterval == 0 && i < iterations && !SaveCheckpoint(checkpoint, grid, i, checkpointFile))
+			return 1;
 	}
+	checkpoint.Wait();
+	int iterationsRun = Max(lastIteration - (int)firstIteration + 1, 1);
+	if (particles)
+		std::cout << "Average particles: " << particleTotal / iterationsRun << "\n";
+	else if (timeBlock > 1)
+		std::cout << "Average active columns: " << 100.0 * columnTotal / ((double)iterationsRun * grid.GetWidth() * grid.GetDepth()) << "%\n";
+	else
+		std::cout << "Average active tiles: " << 100.0 * activeTotal / ((double)iterationsRun * schedule.GetNumTiles()) << "%\n";
 	
 	// Output model
 	std::cout << "Generating model...\n";
@@ -194,3 +793,72 @@ int main(int argc, char **argv)
 	
 	return 0;
 }
+
+int main(int argc, char **argv)
+{
+	using std::string;
+	
+	// Checkpoint to resume from, if any
+	CmdArgs args(argc, argv);
+	args.SetDefault("resume", "");
+	string resumeFile = args.Get<string>("resume");
+	
+	// Read config file
+	Xml xml;
+	xml.Load("Config.xml");
+	
+	// Packed grids take half the memory, but are slower to update and cannot be
+	// checkpointed, memory-mapped or updated synchronously
+	bool synchronous = xml.Get<string>("Engine", "sweep") == "synchronous";
+	if (xml.Get<int>("Grid/Packed", 0) != 0)
+	{
+		if (xml.Get<int>("Checkpoint/Interval", 0) > 0 || !resumeFile.empty() || xml.root.Find("Grid/StorageFile") != NULL)
+		{
+			std::cerr << "Checkpoints and StorageFile are not supported for packed grids\n";
+			return 1;
+		}
+		if (synchronous)
+		{
+			std::cerr << "The synchronous engine is not supported for packed grids\n";
+			return 1;
+		}
+		
+		// Palette of the values the rules use and the config fills the grid with
+		CellRules rules;
+		rules.Load(xml);
+		string values = rules.GetValues();
+		string fills(1, xml.Get<char>("Grid/DefaultValue"));
+		Xml::Element *e = xml.root.GetSubElement("Grid");
+		for (Xml::ElementListType::iterator i = e->subElements.begin(); i != e->subElements.end(); i++)
+		{
+			if ((*i)->name == "Region")
+				fills += (*i)->Get<char>("Value");
+		}
+		for (unsigned int i = 0; i < fills.size(); i++)
+		{
+			if (values.find(fills[i]) == string::npos)
+				values += fills[i];
+		}
+		
+		PackedCellGrid3D grid;
+		grid.SetValues(values);
+		return Run(grid, xml, resumeFile);
+	}
+	
+	// The synchronous engine reads the cells at the start of each iteration from a
+	// second buffer
+	CellGrid3D grid;
+	grid.SetBuffered(synchronous);
+	grid.SetStorageFile(xml.Get<string>("Grid/StorageFile", ""));
+	string pages = xml.Get<string>("Grid/HugePages", "none");
+	if (pages == "transparent")
+		grid.SetPages(CellGrid3D::TRANSPARENT_HUGE_PAGES);
+	else if (pages == "explicit")
+		grid.SetPages(CellGrid3D::HUGE_PAGES);
+	string layout = xml.Get<string>("Grid/Layout", "rows");
+	if (layout == "columns")
+		grid.SetLayout(CellGrid3D::COLUMNS);
+	else if (layout == "bricks")
+		grid.SetLayout(CellGrid3D::BRICKS);
+	return Run(grid, xml, resumeFile);
+}
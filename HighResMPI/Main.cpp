@@ -0,0 +1,376 @@
+#include <mpi.h>
+#include "../Common/CellGrid3D.h"
+#include "../Common/SelectionSet.h"
+#include "../Common/Random.h"
+#include "../Common/Timer.h"
+#include "../Common/Heightmap.h"
+#include "../Common/Xml.h"
+#include "../Common/Obj.h"
+#include "../Common/MathUtils.h"
+#include "../Common/TileSchedule.h"
+#include "../Common/HaloExchange.h"
+#include "../Common/CellRules.h"
+#include "../Common/MiningPlan.h"
+#include "../Common/VoidJumps.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <ctime>
+#include <cstdlib>
+
+// Surface of the output model (cell states and rules are set in the config, see CellRules)
+const char EARTH = 'e';
+
+// Update the columns of a tile from top-right to bottom-left. Columns far enough from the
+// x/z borders for their whole neighbourhood to be inside the grid skip bounds logic entirely.
+template<typename Edge, typename Interior>
+void UpdateTile(Edge &edge, Interior &interior, const Tile &tile, CellRules &rules, unsigned int iteration, int reach)
+{
+	for (int z = tile.z1 - 1; z >= tile.z0; z--)
+	{
+		bool zInside = z >= reach && z < edge.GetDepth() - reach;
+		for (int x = tile.x1 - 1; x >= tile.x0; x--)
+		{
+			if (zInside && x >= reach && x < edge.GetWidth() - reach)
+				rules.UpdateColumn(interior, x, z, iteration);
+			else
+				rules.UpdateColumn(edge, x, z, iteration);
+		}
+	}
+}
+
+// Update a list of tiles in order
+struct IterateTiles
+{
+	CellRules *rules;
+	unsigned int iteration;
+	int reach;
+	const std::vector<Tile> *tiles;
+	
+	template<typename Edge, typename Interior>
+	void operator()(Edge &edge, Interior &interior)
+	{
+		for (unsigned int i = 0; i < tiles->size(); i++)
+			UpdateTile(edge, interior, (*tiles)[i], *rules, iteration, reach);
+	}
+};
+
+void Iterate(CellGrid3D &grid, CellRules &rules, int reach, unsigned int iteration, const std::vector<Tile> &tiles)
+{
+	IterateTiles iterate = { &rules, iteration, reach, &tiles };
+	DispatchBounds(grid, iterate, reach, 1, reach);
+}
+
+// Split a processor's block into the columns that never touch the halo exchange (inner)
+// and a frame of columns within 2 * reach of a shared boundary (outer)
+void CreateTiles(HaloExchange3D &halo, int width, int depth, int reach, std::vector<Tile> &inner, std::vector<Tile> &outer)
+{
+	Tile centre;
+	centre.x0 = halo.HasNeighbour(-1, 0) ? 2 * reach : 0;
+	centre.x1 = halo.HasNeighbour(1, 0) ? width - 2 * reach : width;
+	centre.z0 = halo.HasNeighbour(0, -1) ? 2 * reach : 0;
+	centre.z1 = halo.HasNeighbour(0, 1) ? depth - 2 * reach : depth;
+	
+	inner.clear();
+	outer.clear();
+	if (centre.x0 >= centre.x1 || centre.z0 >= centre.z1)
+	{
+		Tile all = { 0, width, 0, depth, 0, 0 };
+		outer.push_back(all);
+		return;
+	}
+	inner.push_back(centre);
+	
+	// Top-right to bottom-left, the same order as a serial sweep
+	Tile frame[4] = {
+		{ 0, width, centre.z1, depth, 0, 0 },
+		{ centre.x1, width, centre.z0, centre.z1, 0, 0 },
+		{ 0, centre.x0, centre.z0, centre.z1, 0, 0 },
+		{ 0, width, 0, centre.z0, 0, 0 } };
+	for (int i = 0; i < 4; i++)
+	{
+		if (frame[i].x0 < frame[i].x1 && frame[i].z0 < frame[i].z1)
+			outer.push_back(frame[i]);
+	}
+}
+
+// Columns [x0, x0 + width) x [z0, z0 + depth) of the whole grid owned by a processor
+void GetBlock(MPI_Comm cartComm, int rank, int gridWidth, int gridDepth, int &x0, int &z0, int &width, int &depth)
+{
+	int dims[2], periods[2], coords[2];
+	MPI_Cart_get(cartComm, 2, dims, periods, coords);
+	MPI_Cart_coords(cartComm, rank, 2, coords);
+	
+	x0 = coords[0] * gridWidth / dims[0];
+	width = (coords[0] + 1) * gridWidth / dims[0] - x0;
+	z0 = coords[1] * gridDepth / dims[1];
+	depth = (coords[1] + 1) * gridDepth / dims[1] - z0;
+}
+
+void SaveMesh(Heightmap &hmap, float smoothing, const std::string outputFile)
+{
+	hmap.Smooth(smoothing);
+	
+	// Convert heightmap to mesh
+	Mesh *mesh = new Mesh("heightmap");
+	Vertex a, b, c, d;
+	for (int x = 0; x < hmap.GetWidth() - 1; x++)
+	{
+		for (int z = 0; z < hmap.GetDepth() - 1; z++)
+		{
+			a.position = Vector3(x, hmap(x, z + 1), z + 1);
+			b.position = Vector3(x + 1, hmap(x + 1, z + 1), z + 1);
+			c.position = Vector3(x + 1, hmap(x + 1, z), z);
+			d.position = Vector3(x, hmap(x, z), z);
+			mesh->AddQuad(a, b, c, d);
+		}
+	}
+	mesh->CalculateNormals();
+	
+	// Save mesh as wavefront OBJ file
+	Obj obj;
+	obj.AddMesh(mesh);
+	obj.Save(outputFile);
+}
+
+int main(int argc, char **argv)
+{
+	using std::string;
+	
+	// Init MPI
+	int processorIndex;
+	int numProcessors;
+	MPI_Init(&argc, &argv);
+	MPI_Comm_size(MPI_COMM_WORLD, &numProcessors);
+	MPI_Comm_rank(MPI_COMM_WORLD, &processorIndex);
+	bool master = processorIndex == 0;
+	
+	// Read config file
+	Xml xml;
+	xml.Load("Config.xml");
+	Vector3 dimensions = xml.Get<Vector3>("Grid/Dimensions");
+	Vector3 resolution = xml.Get<Vector3>("Grid/Resolution");
+	Vector3 size = dimensions * resolution;
+	int gridWidth = size.x;
+	int gridHeight = size.y;
+	int gridDepth = size.z;
+	
+	// Setup selection set (cell neighbourhood)
+	Vector2 mean = xml.Get<Vector2>("SelectionSet/Mean");
+	Vector2 variance = xml.Get<Vector2>("SelectionSet/Variance");
+	int radius = xml.Get<int>("SelectionSet/Radius");
+	SelectionSet<Vector3> selection;
+	GenerateSelectionSet(selection, mean, variance, radius);
+	
+	// Voids may rise several rows at once through solid earth (1 row by default)
+	VoidJumps jumps;
+	jumps.Create(selection, radius, xml.Get<int>("MaxJump", 1));
+	
+	// Updates reach further for jumps and while settling is tracked, and the halo is as
+	// deep
+	bool stopWhenSettled = xml.Get<int>("StopWhenSettled", 1) != 0;
+	CellRules rules;
+	rules.SetJumps(&jumps);
+	rules.SetSettling(stopWhenSettled);
+	int reach = rules.GetReach(radius);
+	
+	// Arrange processors in a 2D grid over the x/z plane (0 = chosen by MPI)
+	Vector2 processors = xml.Get<Vector2>("Processors", Vector2(0, 0));
+	int dims[2] = { (int)processors.x, (int)processors.y };
+	if ((dims[0] > 0 && dims[1] > 0 && dims[0] * dims[1] != numProcessors) || MPI_Dims_create(numProcessors, 2, dims) != MPI_SUCCESS)
+	{
+		if (master)
+			std::cout << "Error. Processors does not match the " << numProcessors << " processors available.\n";
+		MPI_Finalize();
+		exit(1);
+	}
+	int periods[2] = {
+		xml.Get<string>("Grid/BoundMode/Left") == "wrap" && xml.Get<string>("Grid/BoundMode/Right") == "wrap",
+		xml.Get<string>("Grid/BoundMode/Front") == "wrap" && xml.Get<string>("Grid/BoundMode/Back") == "wrap" };
+	MPI_Comm cartComm;
+	MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &cartComm);
+	
+	int blockX, blockZ, blockWidth, blockDepth;
+	GetBlock(cartComm, processorIndex, gridWidth, gridDepth, blockX, blockZ, blockWidth, blockDepth);
+	if ((dims[0] > 1 && gridWidth / dims[0] < 2 * reach) || (dims[1] > 1 && gridDepth / dims[1] < 2 * reach))
+	{
+		if (master)
+			std::cout << "Error. Each processor requires at least " << 2 * reach << " columns along each split axis.\n";
+		MPI_Finalize();
+		exit(1);
+	}
+	
+	if (master)
+		std::cout << "MPI initialised with " << numProcessors << " processors (" << dims[0] << " x " << dims[1] << ").\n";
+	
+	// Setup grid - sides shared with another processor keep its cells in the halo
+	HaloExchange3D halo(cartComm);
+	CellGrid3D grid;
+	grid.SetHalo(reach);
+	grid.SetSize(blockWidth, gridHeight, blockDepth);
+	
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Top"), CellGrid3D::TOP);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Bottom"), CellGrid3D::BOTTOM);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Left"), CellGrid3D::LEFT);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Right"), CellGrid3D::RIGHT);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Front"), CellGrid3D::FRONT);
+	grid.SetBoundMode(xml.Get<string>("Grid/BoundMode/Back"), CellGrid3D::BACK);
+	if (halo.HasNeighbour(-1, 0))
+		grid.SetBoundMode(CellGrid3D::IGNORE, CellGrid3D::LEFT);
+	if (halo.HasNeighbour(1, 0))
+		grid.SetBoundMode(CellGrid3D::IGNORE, CellGrid3D::RIGHT);
+	if (halo.HasNeighbour(0, -1))
+		grid.SetBoundMode(CellGrid3D::IGNORE, CellGrid3D::FRONT);
+	if (halo.HasNeighbour(0, 1))
+		grid.SetBoundMode(CellGrid3D::IGNORE, CellGrid3D::BACK);
+	
+	// Fill the part of each region inside this processor's block
+	grid.Fill(xml.Get<char>("Grid/DefaultValue"));
+	Xml::Element *e = xml.root.GetSubElement("Grid");
+	for (Xml::ElementListType::iterator i = e->subElements.begin(); i != e->subElements.end(); i++)
+	{
+		if ((*i)->name == "Region")
+		{
+			char value = (*i)->Get<char>("Value");
+			Vector3 position = (*i)->Get<Vector3>("Position") * resolution;
+			Vector3 dimensions = (*i)->Get<Vector3>("Dimensions") * resolution;
+			int x0 = Max((int)position.x, blockX);
+			int x1 = Min((int)position.x + (int)ceil(dimensions.x), blockX + blockWidth);
+			int z0 = Max((int)position.z, blockZ);
+			int z1 = Min((int)position.z + (int)ceil(dimensions.z), blockZ + blockDepth);
+			if (x0 < x1 && z0 < z1)
+				grid.Fill(x0 - blockX, position.y, z0 - blockZ, x1 - x0, ceil(dimensions.y), z1 - z0, value);
+		}
+	}
+	
+	// Every processor uses the same seed - cell streams depend on position in the whole
+	// grid, so a run is reproducible for a given seed and Processors
+	long seed = (long)time(NULL);
+	MPI_Bcast(&seed, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+	Random::SetSeed(xml.Get<long>("Seed", seed));
+	if (master)
+		std::cout << "Random seed " << Random::GetSeed() << "\n";
+	
+	// Load simulation parameters
+	int iterations = xml.Get<int>("Iterations");
+	
+	// Lifetimes are kept for the block's own cells - a void moved into a neighbour's
+	// block draws a new one there (see KillBubble)
+	bool wrapX = grid.GetBoundMode(CellGrid3D::LEFT) == CellGrid3D::WRAP || grid.GetBoundMode(CellGrid3D::RIGHT) == CellGrid3D::WRAP;
+	bool wrapZ = grid.GetBoundMode(CellGrid3D::FRONT) == CellGrid3D::WRAP || grid.GetBoundMode(CellGrid3D::BACK) == CellGrid3D::WRAP;
+	KillBubble killBubble;
+	killBubble.Create(xml.Get<float>("KillBubble"), xml.Get<string>("KillBubbleMode", "bernoulli"), blockWidth, gridHeight, blockDepth, wrapX, wrapZ);
+	float heightmapSmoothing = xml.Get<float>("HeightmapSmoothing");
+	
+	// Compile the rules - random numbers are drawn from the stream of each cell's position
+	// in the whole grid
+	rules.Load(xml);
+	rules.SetNeighbourhood(grid, selection);
+	rules.SetKillBubble(&killBubble);
+	rules.SetOrigin(blockX, 0, blockZ);
+	halo.SetMoved(rules.GetVoids());
+	
+	// Each processor mines the part of the panels inside its block
+	MiningPlan plan;
+	plan.Load(xml, resolution);
+	plan.SetOrigin(blockX, blockZ);
+	unsigned int lastMined = plan.GetLastIteration();
+	NoObserver observer;
+	
+	// Inner columns are updated while the ghost blocks are in flight
+	std::vector<Tile> inner, outer;
+	CreateTiles(halo, blockWidth, blockDepth, reach, inner, outer);
+	halo.Start(grid, reach);
+	
+	Timer timer;
+	timer.Start();
+	
+	// Run simulation
+	if (master)
+		std::cout << "Running simulation...\n";
+	for (int i = 1; i <= iterations; i++)
+	{
+		if (master && i % (iterations / 10) == 0)
+			std::cout << (10 * (i / ((iterations) / 10))) << "%\n";
+		
+		// Faces advance before the iteration's updates, changes to the block's own
+		// cells reach the neighbours with the rest of the iteration's changes
+		if ((unsigned int)i <= lastMined)
+			plan.Advance(grid, rules, i, observer);
+		rules.ResetSettled();
+		Iterate(grid, rules, reach, i, inner);
+		halo.Receive(grid);
+		Iterate(grid, rules, reach, i, outer);
+		halo.Send(grid);
+		
+		// The run stops once the grid has settled on every processor (see HighRes)
+		if (stopWhenSettled && (unsigned int)i > lastMined)
+		{
+			int settled = rules.IsSettled(), all;
+			MPI_Allreduce(&settled, &all, 1, MPI_INT, MPI_LAND, cartComm);
+			if (all)
+			{
+				if (master)
+					std::cout << "Settled after iteration " << i - 1 << " of " << iterations << ", stopping\n";
+				break;
+			}
+		}
+	}
+	halo.Finish(grid);
+	
+	// Surface height of each column in this processor's block
+	std::vector<float> heights(blockWidth * blockDepth);
+	for (int x = 0; x < blockWidth; x++)
+	{
+		for (int z = 0; z < blockDepth; z++)
+		{
+			int y = gridHeight - 1;
+			while (y > 0 && grid(x, y, z) != EARTH)
+				y--;
+			
+			heights[x * blockDepth + z] = y;
+		}
+	}
+	
+	// Collect heights on the master processor
+	std::vector<int> counts(numProcessors), offsets(numProcessors);
+	int total = 0;
+	for (int i = 0; i < numProcessors; i++)
+	{
+		int x0, z0, width, depth;
+		GetBlock(cartComm, i, gridWidth, gridDepth, x0, z0, width, depth);
+		counts[i] = width * depth;
+		offsets[i] = total;
+		total += counts[i];
+	}
+	std::vector<float> allHeights(master ? total : 1);
+	MPI_Gatherv(&heights[0], heights.size(), MPI_FLOAT, &allHeights[0], &counts[0], &offsets[0], MPI_FLOAT, 0, cartComm);
+	
+	if (master)
+	{
+		Heightmap hmap;
+		hmap.SetSize(gridWidth, gridDepth);
+		for (int i = 0; i < numProcessors; i++)
+		{
+			int x0, z0, width, depth;
+			GetBlock(cartComm, i, gridWidth, gridDepth, x0, z0, width, depth);
+			for (int x = 0; x < width; x++)
+			{
+				for (int z = 0; z < depth; z++)
+					hmap(x0 + x, z0 + z) = allHeights[offsets[i] + x * depth + z];
+			}
+		}
+		
+		// Output model
+		std::cout << "Generating model...\n";
+		SaveMesh(hmap, heightmapSmoothing, "HeightMap.obj");
+		std::cout << "Saved file 'HeightMap.obj'\n";
+		
+		timer.Pause();
+		std::cout << "Elapsed time: " << timer.ToString() << std::endl;
+	}
+	
+	MPI_Comm_free(&cartComm);
+	MPI_Finalize();
+	return 0;
+}
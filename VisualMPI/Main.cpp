@@ -2,14 +2,19 @@
 #include <mpi.h>
 #include <iostream>
 #include <string>
+#include <cstring>
+#include <ctime>
 #include "../Common/Graphics.h"
 #include "../Common/CellGrid2D.h"
 #include "../Common/SelectionSet.h"
 #include "../Common/Random.h"
 #include "../Common/Timer.h"
-#include "../Common/SharedMemory.h"
+#include "../Common/HaloExchange.h"
 #include "../Common/Input.h"
 #include "../Common/CmdArgs.h"
+#include "../Common/MathUtils.h"
+#include "../Common/CellRules.h"
+#include "../Common/CellPlane.h"
 
 const char EARTH = 'e';
 const char AIR = 'a';
@@ -17,6 +22,9 @@ const char COAL = 'c';
 const char DRILL = 'd';
 const char VOID = 'v';
 const char STATIC_VOID = 's';
+const char PILLAR = 'p';	// Seam beyond the end of the panel, which the drill stops at
+
+const int RADIUS = 3;
 
 CellGrid2D result;
 
@@ -45,6 +53,7 @@ void Render()
 					colour = Colour::LightBlue();
 					break;
 				case COAL:
+				case PILLAR:
 					colour = Colour::Blue();
 					break;
 				case AIR:
@@ -61,6 +70,43 @@ void Render()
 	}
 }
 				 
+// Update rows top to bottom in [yMin, yMax] of a processor's sector, with the rules of the
+// 3D drivers applied to the grid as the plane z = 0 (see CellRules)
+struct UpdateRows
+{
+	CellRules *rules;
+	int reach;
+	int collapseTop;
+	bool keepGap;
+	unsigned int iteration;
+	int yMax;
+	int yMin;
+	
+	template<typename Edge, typename Interior>
+	void operator()(Edge &edge, Interior &interior)
+	{
+		// Cells are compressed downward up to the sector's top row. Below another sector
+		// the gap filled takes that row, and the sector above falls into it in turn, so
+		// no cell is copied out of the sector above.
+		CellPlane<Edge> edgePlane(edge);
+		CellPlane<Interior> interiorPlane(interior);
+		edgePlane.SetTop(collapseTop, keepGap);
+		interiorPlane.SetTop(collapseTop, keepGap);
+		
+		NoObserver observer;
+		for (int y = yMax; y >= yMin; y--)
+		{
+			for (int x = edge.GetWidth() - 1; x >= 0; x--)
+			{
+				if (x >= reach && x < edge.GetWidth() - reach)
+					rules->Update(interiorPlane, x, y, 0, iteration, observer);
+				else
+					rules->Update(edgePlane, x, y, 0, iteration, observer);
+			}
+		}
+	}
+};
+
 int main(int argc, char **argv)
 {	
 	// Set default parameters
@@ -73,6 +119,7 @@ int main(int argc, char **argv)
 	args.SetDefault("csh", 10);	// Coal Seam Height
 	args.SetDefault("dl", 240);	// Drill Length
 	args.SetDefault("gh", 90);	// Ground Height
+	args.SetDefault("seed", (long)time(NULL));	// Random Seed
 	
 	// Load parameters
 	int xRes = args.Get<int>("rx");
@@ -83,7 +130,7 @@ int main(int argc, char **argv)
 	int coalSeamHeight = args.Get<int>("csh") * yRes;
 	int drillLength = args.Get<int>("dl") * xRes;
 	int groundHeight = args.Get<int>("gh") * yRes;
-	float killBubble = 0.2f / (groundHeight - coalSeamHeight * 2);
+	float killProbability = 0.2f / (groundHeight - coalSeamHeight * 2);
 	
 	// Init MPI
 	int processorIndex;
@@ -95,181 +142,137 @@ int main(int argc, char **argv)
 	if (processorIndex == 0)
 		std::cout << "MPI initialised with " << numProcessors << " processors.\n";
 	
-	// Check if there are enough processors
-	if (numProcessors < 2)
+	// Each processor owns a horizontal band of rows (sector)
+	int sectorY = processorIndex * height / numProcessors;
+	int sectorHeight = (processorIndex + 1) * height / numProcessors - sectorY;
+	
+	// Check sectors are big enough for the halo exchange
+	if (height / numProcessors < 2)
 	{
-		std::cout << "Error. A minimum of 2 processors are required to run.\n";
+		if (processorIndex == 0)
+			std::cout << "Error. Each processor requires at least 2 rows of the grid.\n";
 		MPI_Finalize();
 		exit(1);
 	}
 	
-	// Create processor subgroup for sector processors
-	MPI_Group all;
-	MPI_Group sectorsGroup;
-	MPI_Comm sectorsComm;
-	int exclude[] = { numProcessors - 1 };
-	MPI_Comm_group(MPI_COMM_WORLD, &all);
-	MPI_Group_excl(all, 1, exclude, &sectorsGroup);
-	MPI_Comm_create(MPI_COMM_WORLD, sectorsGroup, &sectorsComm); 
+	// Init cell grid values - ghost rows of neighbouring sectors are kept in the halo
+	CellGrid2D grid;
+	grid.SetHalo(1);
+	grid.SetSize(width, sectorHeight);
+	grid.SetBoundMode(CellGrid2D::WRAP, CellGrid2D::LEFT);
+	grid.SetBoundMode(CellGrid2D::WRAP, CellGrid2D::RIGHT);
+	grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::TOP);
+	grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::BOTTOM);
+	grid.Fill(EARTH);
+	grid.FillRect(0, groundHeight - sectorY, width, height - groundHeight, AIR);
+	grid.FillRect(0, -sectorY, width, coalSeamHeight, COAL);
+	int panelEnd = (width - drillLength) / 2 + drillLength;
+	grid.FillRect(panelEnd + 1, -sectorY, width - panelEnd - 1, coalSeamHeight, PILLAR);
+	grid.FillRect((width - drillLength) / 2, -sectorY, 1, coalSeamHeight, DRILL);
 	
-	if (processorIndex == numProcessors - 1)
-	{
-		RunSharedMemoryServer(numProcessors - 1, width);
-	}
-	else
-	{	
-		int numSectors = numProcessors - 1;
-		
-		// Set sector dimensions
-		int sectorWidth = width;
-		int sectorHeight = height / numSectors + 1;
-		
-		// No shared row on bottom
-		if (processorIndex == 0)
-			sectorHeight--;
-		
-		// Add height remainder to last processor's sector
-		if (processorIndex == numSectors - 1)
-			sectorHeight += height % numSectors;
-		
-		// Set sector position
-		int sectorX = 0;
-		int sectorY = processorIndex * (height / numSectors - 1);
-		if (processorIndex == numSectors - 1)
-			sectorY = processorIndex * (height / numSectors) - 1;
-		
-		// Init cell grid values
-		CellGrid2D grid;
-		grid.SetSize(sectorWidth, sectorHeight);
-		grid.SetBoundMode(CellGrid2D::WRAP, CellGrid2D::LEFT);
-		grid.SetBoundMode(CellGrid2D::WRAP, CellGrid2D::RIGHT);
-		grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::TOP);
-		grid.SetBoundMode(CellGrid2D::IGNORE, CellGrid2D::BOTTOM);
-		grid.Fill(EARTH);
-		grid.FillRect(0, groundHeight - sectorY, width, height - groundHeight, AIR);
-		grid.FillRect(0, -sectorY, width, coalSeamHeight, COAL);
-		grid.FillRect((width - drillLength) / 2, -sectorY, 1, coalSeamHeight, DRILL);
-		
-		// Init shared memory
-		SharedMemory shm(numProcessors - 1, width);
-		shm.Init(processorIndex, grid.GetRow(sectorHeight - 1));
+	// Init halo exchange with the sectors above and below
+	int below = (processorIndex > 0) ? processorIndex - 1 : MPI_PROC_NULL;
+	int above = (processorIndex < numProcessors - 1) ? processorIndex + 1 : MPI_PROC_NULL;
+	HaloExchange2D halo(MPI_COMM_WORLD, below, above);
+	halo.Start(grid);
+	
+	// Init random neighbour selection - voids rise one row at a time
+	// Cell streams depend on position in the whole grid, so every processor uses the
+	// master's seed
+	long seed = args.Get<long>("seed");
+	MPI_Bcast(&seed, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+	Random::SetSeed(seed);
+	SelectionSet<Vector3> selection;
+	GenerateSelectionSet(selection, 0.0, 3.0, -RADIUS, RADIUS);
+	
+	// Default rules (see CellRules), the drill advances through coal up to the pillar
+	KillBubble killBubble;
+	killBubble.Create(killProbability, KillBubble::BERNOULLI, 0, 0, 0, false, false);
+	CellRules rules;
+	rules.SetNeighbourhood(CellPlane<CellGrid2D>(grid), selection);
+	rules.SetKillBubble(&killBubble);
+	rules.SetOrigin(0, sectorY, 0);
+	rules.SetSettling(true);
+	halo.SetMoved(rules.GetVoids());
+	UpdateRows update = { &rules, rules.GetReach(RADIUS), sectorHeight - 1, above != MPI_PROC_NULL, 0, 0, 0 };
+	
+	if (processorIndex == 0)
+		std::cout << "Running simulation...\n";
+	
+	Timer timer;
+	timer.Start();
+	for (int i = 1; i <= iterations; i++)
+	{				
+		// Print simulation percentage completed
+		if (processorIndex == 0 && i % (iterations / 10) == 0)
+			std::cout << (10 * (i / ((iterations) / 10))) << "%\n";
+		update.iteration = i;
+		rules.ResetSettled();
 		
-		// Init random neighbour selection
-		Random::SetSeed(); 
-		SelectionSet<int> neighbourhood;
-		GenerateSelectionSet(neighbourhood, 0.0, 3.0, -3, 3);
+		// Rows above 1 only touch the ghost row above - update them while the
+		// message from the sector below is still in flight
+		halo.ReceiveAbove(grid);
+		update.yMax = sectorHeight - 1;
+		update.yMin = 2;
+		DispatchBounds(grid, update, update.reach, 1);
 		
-		if (processorIndex == 0)
-			std::cout << "Running simulation...\n";
+		halo.ReceiveBelow(grid);
+		update.yMax = Min(sectorHeight - 1, 1);
+		update.yMin = 0;
+		DispatchBounds(grid, update, update.reach, 1);
 		
-		Timer timer;
-		timer.Start();
-		for (int i = 1; i <= iterations; i++)
-		{				
-			// Print simulation percentage completed
-			if (processorIndex == 0 && i % (iterations / 10) == 0)
-				std::cout << (10 * (i / ((iterations) / 10))) << "%\n";
-			
-			for (int y = grid.GetHeight() - 2; y >= 0; y--)
-			{
-				// Obtain required shared memory locks
-				if (y == grid.GetHeight() - 2)
-					shm.Obtain(processorIndex, grid.GetRow(sectorHeight - 1));
-				if (y == 0 && processorIndex != 0)
-					shm.Obtain(processorIndex - 1, grid.GetRow(0));
-				
-				// Update row
-				for (int x = grid.GetWidth() - 1; x >= 0; x--)
-				{
-					int offset;
-					switch (grid(x, y))
-					{
-						case VOID:
-							offset = neighbourhood.RouletteSelect();
-							if (grid(x + offset, y + 1) == EARTH || grid(x + offset, y + 1) == AIR)
-							{
-								if (Random::Float() < killBubble)
-									grid(x, y) = STATIC_VOID;
-								else
-								{
-									grid(x, y) = grid(x + offset, y + 1);
-									grid(x + offset, y + 1) = VOID;
-								}
-							}
-							break;
-						case DRILL:
-							grid(x, y) = VOID;
-							if (x < (width - drillLength) / 2 + drillLength)
-								grid(x + 1, y) = DRILL;
-							break;
-						case EARTH:
-							if (grid(x, y - 1) == AIR || grid(x, y - 1) == STATIC_VOID)
-							{
-								if (grid(x - 1, y - 1) == AIR || grid(x + 1, y - 1) == AIR
-									|| grid(x - 1, y) == AIR || grid(x + 1, y) == AIR
-									|| grid(x - 1, y - 1) == STATIC_VOID || grid(x + 1, y - 1) == STATIC_VOID
-									|| grid(x - 1, y) == STATIC_VOID || grid(x + 1, y) == STATIC_VOID)
-								{
-									for (int i = y - 1; i < grid.GetHeight() - 1; i++)
-										grid(x, i) = grid(x, i + 1);
-								}
-							}
-							break;
-					}
-				}
-				
-				// Release shared memory locks
-				if (y == grid.GetHeight() - 2 || (y == 0 && processorIndex != 0))
-					shm.Release();
-			}
-			
-			// Sync before next iteration
-			MPI_Barrier(sectorsComm);
-		}
+		halo.Send(grid);
 		
-		if (processorIndex != 0)
-		{
-			// Send final data to master-processor
-			int size = grid.GetWidth() * grid.GetHeight();
-			MPI_Send(grid.GetRawData(), size, MPI_CHAR, 0, 0, MPI_COMM_WORLD);
-		}
-		else
+		// Nothing but voids in the air moves once every sector has settled
+		int settled = rules.IsSettled(), all;
+		MPI_Allreduce(&settled, &all, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+		if (all)
 		{
-			std::cout << "Collecting results...\n";
-			
-			// Create cellgrid to hold final data
-			result.SetSize(width, height);
-			result.SetBoundMode(CellGrid2D::EXCEPTION);
-			result.CopyCells(grid.GetRawData(), width, height / numSectors, 0, 0);
-			
-			// Recieve final data from all other sector processors
-			int bufferSize = sectorWidth * sectorHeight * 2;
-			char *cellData = new char[bufferSize];
-			for (int i = 1; i < numSectors; i++)
-			{	
-				MPI_Recv(cellData, bufferSize, MPI_CHAR, i, 0, MPI_COMM_WORLD, 0);
-				
-				int copyHeight = height / numSectors + 1;
-				if (i == numSectors - 1) copyHeight += height % numProcessors;
-				
-				int copyY = i * (height / numSectors - 1);
-				if (processorIndex == numSectors - 1)
-					copyY = i * (height / numSectors) - 1;
-				
-				result.CopyCells(cellData, width, copyHeight, 0, copyY);
-			}
-			delete[] cellData;
-			
-			timer.Pause();
-			std::cout << "Elapsed time: " << timer.ToString() << std::endl;
-			
-			shm.Terminate();
-			
-			// Display result in OpenGL window
-			InitWindow(width, height, "Cellular Automata Test", Colour::White());
-			RunApp(30, Update, Render);
+			if (processorIndex == 0)
+				std::cout << "Settled after iteration " << i - 1 << " of " << iterations << ", stopping\n";
+			break;
 		}
 	}
+	halo.Finish(grid);
+	
+	// Collect owned rows on the master processor
+	int *counts = new int[numProcessors];
+	int *offsets = new int[numProcessors];
+	for (int i = 0; i < numProcessors; i++)
+	{
+		offsets[i] = (i * height / numProcessors) * width;
+		counts[i] = ((i + 1) * height / numProcessors) * width - offsets[i];
+	}
+	
+	// Sectors are gathered densely, so neither grid's row stride matters
+	char *cellData = new char[sectorHeight * width];
+	char *gathered = NULL;
+	grid.ExtractCells(cellData, width, sectorHeight, 0, 0);
+	
+	if (processorIndex == 0)
+	{
+		std::cout << "Collecting results...\n";
+		result.SetSize(width, height);
+		result.SetBoundMode(CellGrid2D::EXCEPTION);
+		gathered = new char[width * height];
+	}
+	MPI_Gatherv(cellData, sectorHeight * width, MPI_CHAR, gathered, counts, offsets, MPI_CHAR, 0, MPI_COMM_WORLD);
+	if (processorIndex == 0)
+		result.CopyCells(gathered, width, height, 0, 0);
+	delete[] cellData;
+	delete[] gathered;
+	delete[] counts;
+	delete[] offsets;
+	
+	if (processorIndex == 0)
+	{
+		timer.Pause();
+		std::cout << "Elapsed time: " << timer.ToString() << std::endl;
+		
+		// Display result in OpenGL window
+		InitWindow(width, height, "Cellular Automata Test", Colour::White());
+		RunApp(30, Update, Render);
+	}
 	
 	MPI_Finalize();
 	return 0;